@@ -0,0 +1,194 @@
+/** @file BackupManifest.cpp
+ * @brief BackupManifest definition
+ *
+ * @ingroup core
+ */
+
+#include "BackupManifest.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <regex>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+/** @brief Name of the manifest file in the experiment folder
+ */
+const string MANIFEST_FILE_NAME = "backups.manifest";
+
+
+/** @brief Initializer: no bytes processed
+ */
+FileChecksum::FileChecksum() {
+    this->bytes = 0;
+}
+
+
+/** @brief Add data to the checksum
+ *
+ * @param[in] data Bytes to add
+ * @param[in] size Number of bytes
+ */
+void FileChecksum::process(const char* data, size_t size) {
+    this->_crc.process_bytes(data, size);
+    this->bytes += size;
+}
+
+
+/** @brief Get CRC-32 of the bytes processed so far
+ */
+uint32_t FileChecksum::crc32() const {
+    return this->_crc.checksum();
+}
+
+
+/** @brief Compute the checksum of a file already on disk
+ *
+ * @param[in] path Path of file
+ */
+FileChecksum checksumFile(const string& path) {
+    FileChecksum checksum;
+    ifstream f_data(path, ios::in | ios::binary);
+    if (!f_data)
+        throw runtime_error("can't read " + path);
+    vector<char> buffer(1 << 20);
+    while (f_data) {
+        f_data.read(buffer.data(), buffer.size());
+        checksum.process(buffer.data(), (size_t)f_data.gcount());
+    }
+    return checksum;
+}
+
+
+/** @brief Format an entry as a line of the manifest
+ */
+static string _formatEntry(const ManifestEntry& entry) {
+    ostringstream line;
+    line << entry.time << " " << entry.kind << " " << entry.bytes << " "
+         << hex << setw(8) << setfill('0') << entry.crc32 << " " << entry.path << "\n";
+    return line.str();
+}
+
+
+/** @brief Initializer
+ *
+ * @param[in] experiment_path Path of experiment folder
+ */
+BackupManifest::BackupManifest(fs::path experiment_path) {
+    this->_experiment_path = experiment_path;
+    this->_manifest_path = experiment_path / MANIFEST_FILE_NAME;
+}
+
+
+/** @brief Check if the manifest file exists
+ */
+bool BackupManifest::exists() {
+    return fs::exists(this->_manifest_path);
+}
+
+
+/** @brief Record a file which has just been written
+ *
+ * @param[in] time Time slice saved in the file
+ * @param[in] file Path of file (inside experiment folder)
+ * @param[in] checksum Checksum of file contents
+ */
+void BackupManifest::append(int time, const string& file, const FileChecksum& checksum) {
+    fs::path file_path(file);
+    ManifestEntry entry;
+    entry.time = time;
+    entry.kind = file_path.extension().string().substr(1);
+    entry.bytes = checksum.bytes;
+    entry.crc32 = checksum.crc32();
+    entry.path = file_path.lexically_relative(this->_experiment_path).string();
+    string line = _formatEntry(entry);
+
+    lock_guard<mutex> lock(this->_mtx);
+    ofstream f_manifest(this->_manifest_path.string(), ios::out | ios::app | ios::binary);
+    f_manifest.write(line.data(), line.size());
+    f_manifest.close();
+    if (f_manifest.fail())
+        throw runtime_error("can't write " + this->_manifest_path.string());
+}
+
+
+/** @brief Get the files recorded in the manifest, sorted by time
+ *
+ * When a file appears several times only its last entry is kept.
+ * Returns nothing if there is no manifest.
+ */
+vector<ManifestEntry> BackupManifest::entries() {
+    vector<ManifestEntry> entries;
+    map<string, size_t> entry_of_file;
+    lock_guard<mutex> lock(this->_mtx);
+    ifstream f_manifest(this->_manifest_path.string(), ios::in | ios::binary);
+    string line;
+    while (getline(f_manifest, line)) {
+        if (f_manifest.eof())
+            break;  // last line without "\n": interrupted append
+        istringstream fields(line);
+        ManifestEntry entry;
+        fields >> entry.time >> entry.kind >> entry.bytes >> hex >> entry.crc32 >> ws;
+        getline(fields, entry.path);
+        if (fields.fail() || entry.path.empty())
+            continue;
+        auto it = entry_of_file.find(entry.path);
+        if (it == entry_of_file.end()) {
+            entry_of_file[entry.path] = entries.size();
+            entries.push_back(entry);
+        } else {
+            entries[it->second] = entry;
+        }
+    }
+    stable_sort(entries.begin(), entries.end(), [](const ManifestEntry& a, const ManifestEntry& b) {
+        return a.time < b.time;
+    });
+    return entries;
+}
+
+
+/** @brief Create the manifest from the files in the experiment folder
+ *
+ * Used for experiments written before manifests existed: the folder is
+ * walked once and every file checksummed.
+ */
+void BackupManifest::rebuild() {
+    regex re("^bk_(\\d+)\\.(zjson|ecobin|ecodelta|tga)$");
+    vector<ManifestEntry> entries;
+    for(fs::recursive_directory_iterator it(this->_experiment_path);
+        it!=fs::recursive_directory_iterator();
+        ++it)
+    {
+        if (fs::is_directory(*it))
+            continue;
+        string file_name = it->path().filename().string();
+        smatch match;
+        if (!regex_match(file_name, match, re))
+            continue;
+        FileChecksum checksum = checksumFile(it->path().string());
+        ManifestEntry entry;
+        entry.time = atoi(match.str(1).c_str());
+        entry.kind = match.str(2);
+        entry.bytes = checksum.bytes;
+        entry.crc32 = checksum.crc32();
+        entry.path = it->path().lexically_relative(this->_experiment_path).string();
+        entries.push_back(entry);
+    }
+    sort(entries.begin(), entries.end(), [](const ManifestEntry& a, const ManifestEntry& b) {
+        return (a.time < b.time) || ((a.time == b.time) && (a.path < b.path));
+    });
+
+    lock_guard<mutex> lock(this->_mtx);
+    string tmp_path = this->_manifest_path.string() + ".tmp";
+    ofstream f_manifest(tmp_path, ios::out | ios::binary);
+    for (const ManifestEntry& entry : entries)
+        f_manifest << _formatEntry(entry);
+    f_manifest.close();
+    if (f_manifest.fail())
+        throw runtime_error("can't write " + tmp_path);
+    if (rename(tmp_path.c_str(), this->_manifest_path.string().c_str()) != 0)
+        throw runtime_error("can't rename " + tmp_path);
+}
@@ -0,0 +1,102 @@
+/** @file BackupManifest.h
+ * @brief Header of BackupManifest
+ *
+ * @ingroup core
+ */
+
+#ifndef BACKUPMANIFEST_H_INCLUDED
+#define BACKUPMANIFEST_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/operations.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+
+/** @brief Byte count and CRC-32 of data written to a file
+ */
+class FileChecksum {
+public:
+    FileChecksum();
+    void process(const char* data, size_t size);
+    uint32_t crc32() const;
+    uint64_t bytes;
+private:
+    boost::crc_32_type _crc;
+};
+
+
+/** @brief Output filter computing the FileChecksum of the data passing through it
+ *
+ * @ingroup core
+ */
+class ChecksumFilter : public boost::iostreams::multichar_output_filter {
+public:
+    ChecksumFilter(FileChecksum& checksum) : _checksum(&checksum) {}
+
+    template <typename Sink>
+    streamsize write(Sink& sink, const char* s, streamsize n) {
+        streamsize written = boost::iostreams::write(sink, s, n);
+        if (written > 0)
+            this->_checksum->process(s, (size_t)written);
+        return written;
+    }
+private:
+    FileChecksum* _checksum;
+};
+
+
+/** @brief File of an experiment, as recorded in its manifest
+ */
+struct ManifestEntry {
+    int time;
+    /** @brief File extension without dot: "zjson", "ecobin", "ecodelta", "tga"
+    * or "ecoframes" (the frame archive, recorded each time it is opened for
+    * appending, with its bytes at that moment and a crc32 of 0)
+    */
+    string kind;
+    uint64_t bytes;
+    uint32_t crc32;
+    /** @brief Path relative to experiment folder
+    */
+    string path;
+};
+
+FileChecksum checksumFile(const string& path);
+
+
+/** @brief Append-only index of the files (backups and images) of an experiment
+ *
+ * Every file written to the experiment folder is recorded as a line
+ * "<time> <kind> <bytes> <crc32> <path>" of a text file, so listing backups
+ * or computing the experiment size reads one file instead of walking the
+ * folder. When a file is overwritten (e.g. an experiment resumed from an
+ * earlier time) a new line is appended and the last one wins.
+ * Lines which can't be parsed (a write interrupted by a crash) are ignored.
+ *
+ * append() can be called from several threads.
+ *
+ * @ingroup core
+ */
+class BackupManifest {
+public:
+    BackupManifest(fs::path experiment_path);
+    bool exists();
+    void append(int time, const string& file, const FileChecksum& checksum);
+    vector<ManifestEntry> entries();
+    void rebuild();
+private:
+    fs::path _experiment_path;
+    fs::path _manifest_path;
+    mutex _mtx;
+};
+
+
+#endif  // BACKUPMANIFEST_H_INCLUDED
@@ -0,0 +1,177 @@
+/** @file BlockCompression.cpp
+ * @brief Block-compressed files definition
+ *
+ * @ingroup core
+ */
+
+#include "BlockCompression.h"
+#include <cstring>
+#include <stdexcept>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+
+namespace bio=boost::iostreams;
+
+
+/** @brief Compress data in independent blocks, in parallel, and write them with their index
+ *
+ * @param[out] out Output stream (binary)
+ * @param[in] data Raw bytes
+ * @param[in] size Number of raw bytes
+ * @param[in] block_size Raw bytes per block
+ * @param[in] level zlib compression level (1 fastest, 9 best)
+ * @param[in] pool Threads compressing blocks
+ */
+void writeBlockCompressed(ostream& out, const char* data, size_t size, size_t block_size, int level, ThreadPool& pool) {
+    BlockFileHeader header;
+    memset(&header, 0, sizeof(BlockFileHeader));
+    memcpy(header.magic, BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC));
+    header.version = BLOCK_FILE_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.raw_size = size;
+    header.block_size = block_size;
+    header.num_blocks = (size + block_size - 1) / block_size;
+
+    vector<vector<char>> blocks(header.num_blocks);
+    pool.parallelFor((int)header.num_blocks, [&](int b) {
+        size_t begin = (size_t)b * block_size;
+        size_t end = min(size, begin + block_size);
+        bio::filtering_ostream compressed;
+        compressed.push(bio::zlib_compressor(bio::zlib_params(level)));
+        compressed.push(bio::back_inserter(blocks[b]));
+        compressed.write(data + begin, end - begin);
+        compressed.reset();  // flush compressor
+    });
+
+    vector<BlockIndexEntry> index(header.num_blocks);
+    uint64_t offset = sizeof(BlockFileHeader) + header.num_blocks * sizeof(BlockIndexEntry);
+    for (uint64_t b = 0; b < header.num_blocks; b++) {
+        index[b].offset = offset;
+        index[b].compressed_size = blocks[b].size();
+        offset += blocks[b].size();
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(BlockFileHeader));
+    out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(BlockIndexEntry));
+    for (auto& block : blocks)
+        out.write(block.data(), block.size());
+}
+
+/** @brief true if data starts like a block-compressed file
+ */
+bool isBlockCompressed(const char* data, size_t size) {
+    return (size >= sizeof(BlockFileHeader)) && (memcmp(data, BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC)) == 0);
+}
+
+
+/*********************************************************
+ * BlockCompressedView implementation
+ */
+
+/** @brief Initializer: check header and block index
+ *
+ * @param[in] data File bytes (must be 8-byte aligned and outlive the view)
+ * @param[in] size Number of bytes in data
+ */
+BlockCompressedView::BlockCompressedView(const char* data, size_t size) : _data(data), _size(size) {
+    if (!isBlockCompressed(data, size))
+        throw runtime_error("not a block-compressed file");
+    this->_header = reinterpret_cast<const BlockFileHeader*>(data);
+    this->_index = reinterpret_cast<const BlockIndexEntry*>(data + sizeof(BlockFileHeader));
+    if (this->_header->byte_order != SNAPSHOT_BYTE_ORDER)
+        throw runtime_error("block-compressed file written with a different byte order");
+    if (this->_header->version != BLOCK_FILE_VERSION)
+        throw runtime_error("unsupported block-compressed file version " + to_string(this->_header->version));
+    if ((this->_header->block_size == 0) ||
+        (this->_header->num_blocks != this->_header->raw_size / this->_header->block_size
+                                      + (this->_header->raw_size % this->_header->block_size != 0)) ||
+        !sectionFits(sizeof(BlockFileHeader), this->_header->num_blocks, sizeof(BlockIndexEntry), size))
+        throw runtime_error("corrupted block-compressed file");
+    for (uint64_t b = 0; b < this->_header->num_blocks; b++) {
+        if (!sectionFits(this->_index[b].offset, this->_index[b].compressed_size, 1, size))
+            throw runtime_error("truncated block-compressed file");
+    }
+}
+
+uint64_t BlockCompressedView::_blockRawSize(uint64_t block) const {
+    return min(this->_header->block_size, this->_header->raw_size - block * this->_header->block_size);
+}
+
+/** @brief Decompress one block
+ *
+ * @param[in] block Block number
+ * @param[out] raw_data Destination of the block (block_size bytes at most)
+ */
+void BlockCompressedView::decompressBlock(uint64_t block, char* raw_data) const {
+    const BlockIndexEntry& entry = this->_index[block];
+    bio::filtering_istream decompressed;
+    decompressed.push(bio::zlib_decompressor());
+    decompressed.push(bio::array_source(this->_data + entry.offset, entry.compressed_size));
+    streamsize raw_size = (streamsize)this->_blockRawSize(block);
+    decompressed.read(raw_data, raw_size);
+    if (decompressed.gcount() != raw_size)
+        throw runtime_error("corrupted block " + to_string(block) + " of block-compressed file");
+}
+
+/** @brief Decompress all blocks in parallel
+ *
+ * @param[out] raw_data Destination (rawSize() bytes)
+ * @param[in] pool Threads decompressing blocks
+ */
+void BlockCompressedView::decompressAll(char* raw_data, ThreadPool& pool) const {
+    pool.parallelFor((int)this->numBlocks(), [&](int b) {
+        try {
+            this->decompressBlock(b, raw_data + b * this->_header->block_size);
+        } catch (exception&) {  // e.g. zlib error
+            throw runtime_error("corrupted block " + to_string(b) + " of block-compressed file");
+        }
+    });
+}
+
+/** @brief Read a region of raw bytes, decompressing only the blocks covering it
+ *
+ * E.g. the header of a snapshot, and then a range of one of its columns.
+ *
+ * @param[in] raw_offset Offset of the region in raw bytes
+ * @param[in] size Size of the region
+ * @param[out] dst Destination of the region
+ */
+void BlockCompressedView::read(uint64_t raw_offset, size_t size, char* dst) const {
+    if (raw_offset + size > this->rawSize())
+        throw out_of_range("region out of block-compressed file");
+    uint64_t block_size = this->_header->block_size;
+    vector<char> block_data(block_size);
+    while (size > 0) {
+        uint64_t block = raw_offset / block_size;
+        uint64_t offset_in_block = raw_offset - block * block_size;
+        size_t num_bytes = (size_t)min<uint64_t>(size, this->_blockRawSize(block) - offset_in_block);
+        this->decompressBlock(block, block_data.data());
+        memcpy(dst, block_data.data() + offset_in_block, num_bytes);
+        dst += num_bytes;
+        raw_offset += num_bytes;
+        size -= num_bytes;
+    }
+}
+
+
+/*********************************************************
+ * DecodedFile implementation
+ */
+
+/** @brief Initializer: map a file and decompress it if it is block-compressed
+ *
+ * @param[in] path Path of the file
+ * @param[in] pool Threads decompressing blocks
+ */
+DecodedFile::DecodedFile(const string& path, ThreadPool& pool) : _mapped_file(path) {
+    this->_data = this->_mapped_file.data();
+    this->_size = this->_mapped_file.size();
+    if (isBlockCompressed(this->_data, this->_size)) {
+        BlockCompressedView view(this->_data, this->_size);
+        this->_decompressed.resize((view.rawSize() + 7) / 8);
+        view.decompressAll(reinterpret_cast<char*>(this->_decompressed.data()), pool);
+        this->_data = reinterpret_cast<const char*>(this->_decompressed.data());
+        this->_size = view.rawSize();
+    }
+}
@@ -0,0 +1,95 @@
+/** @file BlockCompression.h
+ * @brief Header of block-compressed files
+ *
+ * @ingroup core
+ */
+
+#ifndef BLOCKCOMPRESSION_H_INCLUDED
+#define BLOCKCOMPRESSION_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "ThreadPool.h"
+#include "Snapshot.h"
+
+using namespace std;
+
+
+/** @brief Fixed-size header at the beginning of a block-compressed file
+ *
+ * The original (raw) bytes are split in blocks of block_size bytes (the
+ * last one can be smaller), each compressed independently with zlib. The
+ * header is followed by the block index (num_blocks BlockIndexEntry) and
+ * then by the compressed blocks. Blocks can be decompressed in parallel,
+ * or one by one to read only a region of the raw bytes.
+ *
+ * @ingroup core
+ */
+struct BlockFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t raw_size;
+    uint64_t block_size;
+    uint64_t num_blocks;
+};
+
+/** @brief Location of a compressed block in a block-compressed file
+ */
+struct BlockIndexEntry {
+    uint64_t offset;
+    uint64_t compressed_size;
+};
+
+const char BLOCK_FILE_MAGIC[8] = {'E', 'C', 'O', 'B', 'L', 'O', 'C', 'K'};
+const uint32_t BLOCK_FILE_VERSION = 1;
+
+void writeBlockCompressed(ostream& out, const char* data, size_t size, size_t block_size, int level, ThreadPool& pool);
+bool isBlockCompressed(const char* data, size_t size);
+
+
+/** @brief Read-only view of a block-compressed file held in memory (not owned)
+ *
+ * @ingroup core
+ */
+class BlockCompressedView {
+public:
+    BlockCompressedView(const char* data, size_t size);
+    uint64_t rawSize() const { return this->_header->raw_size; }
+    uint64_t numBlocks() const { return this->_header->num_blocks; }
+    void decompressBlock(uint64_t block, char* raw_data) const;
+    void decompressAll(char* raw_data, ThreadPool& pool) const;
+    void read(uint64_t raw_offset, size_t size, char* dst) const;
+private:
+    const char* _data;
+    size_t _size;
+    const BlockFileHeader* _header;
+    const BlockIndexEntry* _index;
+    uint64_t _blockRawSize(uint64_t block) const;
+};
+
+
+/** @brief Contents of a backup file, stored raw or block-compressed
+ *
+ * A raw file is just mapped in memory (no copy). A block-compressed file is
+ * mapped and decompressed in parallel into an 8-byte aligned buffer.
+ *
+ * @ingroup core
+ */
+class DecodedFile {
+public:
+    DecodedFile(const string& path, ThreadPool& pool);
+    const char* data() const { return this->_data; }
+    size_t size() const { return this->_size; }
+private:
+    MappedFile _mapped_file;
+    vector<uint64_t> _decompressed;
+    const char* _data;
+    size_t _size;
+};
+
+
+#endif  // BLOCKCOMPRESSION_H_INCLUDED
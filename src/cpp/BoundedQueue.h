@@ -0,0 +1,104 @@
+/** @file BoundedQueue.h
+ * @brief BoundedQueue definition (header only)
+ *
+ * @ingroup core
+ */
+
+#ifndef BOUNDEDQUEUE_H_INCLUDED
+#define BOUNDEDQUEUE_H_INCLUDED
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+
+/** @brief FIFO queue with a maximum size, shared by producer and consumer threads
+ *
+ * push() blocks while the queue is full (backpressure), tryPush() refuses
+ * the item instead (for producers which prefer dropping items to waiting),
+ * pop() blocks while it is empty. Once closed, push() is refused and pop()
+ * returns the remaining items and then false.
+ *
+ * @ingroup core
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(size_t capacity) : _capacity(capacity), _closed(false) {}
+
+    /** @brief Append an item, waiting for room if the queue is full
+    *
+    * @param[in] item Item to be appended (moved)
+    * @param[out] waited Set to true if the queue was full
+    * @returns false if the queue is closed (item is not appended)
+    */
+    bool push(T&& item, bool* waited = nullptr) {
+        unique_lock<mutex> lock(this->_mtx);
+        if (waited != nullptr)
+            *waited = (this->_items.size() >= this->_capacity);
+        this->_cv_not_full.wait(lock, [this] { return this->_closed || (this->_items.size() < this->_capacity); });
+        if (this->_closed)
+            return false;
+        this->_items.push_back(move(item));
+        this->_cv_not_empty.notify_one();
+        return true;
+    }
+
+    /** @brief Append an item only if there is room, without waiting
+    *
+    * @param[in] item Item to be appended (moved only if appended)
+    * @returns false if the queue is full or closed (item is not appended)
+    */
+    bool tryPush(T&& item) {
+        lock_guard<mutex> lock(this->_mtx);
+        if (this->_closed || (this->_items.size() >= this->_capacity))
+            return false;
+        this->_items.push_back(move(item));
+        this->_cv_not_empty.notify_one();
+        return true;
+    }
+
+    /** @brief Take the oldest item, waiting for one if the queue is empty
+    *
+    * @param[out] item Item taken
+    * @returns false if the queue is closed and empty
+    */
+    bool pop(T& item) {
+        unique_lock<mutex> lock(this->_mtx);
+        this->_cv_not_empty.wait(lock, [this] { return this->_closed || !this->_items.empty(); });
+        if (this->_items.empty())
+            return false;
+        item = move(this->_items.front());
+        this->_items.pop_front();
+        this->_cv_not_full.notify_one();
+        return true;
+    }
+
+    /** @brief Refuse new items and wake up all waiting threads
+    */
+    void close() {
+        lock_guard<mutex> lock(this->_mtx);
+        this->_closed = true;
+        this->_cv_not_empty.notify_all();
+        this->_cv_not_full.notify_all();
+    }
+
+    size_t size() {
+        lock_guard<mutex> lock(this->_mtx);
+        return this->_items.size();
+    }
+
+    size_t capacity() const { return this->_capacity; }
+private:
+    size_t _capacity;
+    bool _closed;
+    deque<T> _items;
+    mutex _mtx;
+    condition_variable _cv_not_empty;
+    condition_variable _cv_not_full;
+};
+
+
+#endif  // BOUNDEDQUEUE_H_INCLUDED
@@ -0,0 +1,238 @@
+/** @file CheckpointWriter.cpp
+ * @brief CheckpointWriter definition
+ *
+ * @ingroup core
+ */
+
+#include "CheckpointWriter.h"
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include "BlockCompression.h"
+
+namespace bio=boost::iostreams;
+
+
+/** @brief Write a file through a temporary file, synced to disk before being renamed
+ *
+ * @param[in] path Destination path
+ * @param[in] write Function writing file contents to a stream
+ *
+ * @returns Checksum of the data written
+ */
+static FileChecksum _writeFileAtomically(const string& path, const function<void(ostream&)>& write) {
+    string tmp_path = path + ".tmp";
+    fs::create_directories(fs::path(path).parent_path());
+    ofstream f_data;
+    f_data.open(tmp_path, ios::out | ios::binary);
+    FileChecksum checksum;
+    bool stream_failed;
+    {
+        bio::filtering_ostream checked_out;
+        checked_out.push(ChecksumFilter(checksum));
+        checked_out.push(f_data);
+        write(checked_out);
+        checked_out.flush();
+        stream_failed = checked_out.fail();
+    }
+    f_data.close();
+    if (stream_failed || f_data.fail())
+        throw runtime_error("can't write " + tmp_path);
+    int fd = open(tmp_path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+        throw runtime_error("can't rename " + tmp_path);
+    return checksum;
+}
+
+
+/** @brief Initializer: start writer thread
+ *
+ * @param[in] queue_capacity Maximum number of checkpoints waiting to be written
+ * @param[in] manifest Manifest where written files are recorded (nullptr for none)
+ */
+CheckpointWriter::CheckpointWriter(size_t queue_capacity, BackupManifest* manifest) : _queue(queue_capacity) {
+    this->_manifest = manifest;
+    this->_stats = CheckpointWriterStats();
+    this->_worker = thread(&CheckpointWriter::_workerLoop, this);
+}
+
+
+/** @brief Destructor: write all pending checkpoints and stop writer thread
+ */
+CheckpointWriter::~CheckpointWriter() {
+    this->_queue.close();
+    this->_worker.join();
+}
+
+
+/** @brief Get an (empty or recycled) checkpoint to be filled and submitted
+ */
+unique_ptr<Checkpoint> CheckpointWriter::acquire() {
+    lock_guard<mutex> lock(this->_mtx);
+    if (this->_recycled.empty())
+        return unique_ptr<Checkpoint>(new Checkpoint());
+    unique_ptr<Checkpoint> checkpoint = move(this->_recycled.back());
+    this->_recycled.pop_back();
+    return checkpoint;
+}
+
+
+/** @brief Queue a checkpoint to be written, waiting if the queue is full
+ *
+ * @param[in] checkpoint Checkpoint got from acquire() and filled
+ */
+void CheckpointWriter::submit(unique_ptr<Checkpoint> checkpoint) {
+    {
+        lock_guard<mutex> lock(this->_mtx);
+        this->_stats.submitted++;
+    }
+    auto start = chrono::steady_clock::now();
+    bool waited = false;
+    this->_queue.push(move(checkpoint), &waited);
+    if (waited) {
+        auto end = chrono::steady_clock::now();
+        lock_guard<mutex> lock(this->_mtx);
+        this->_stats.stalls++;
+        this->_stats.stall_ms += chrono::duration<double, milli>(end - start).count();
+    }
+}
+
+
+/** @brief Wait until all submitted checkpoints are written
+ */
+void CheckpointWriter::flush() {
+    unique_lock<mutex> lock(this->_mtx);
+    this->_cv_flushed.wait(lock, [this] {
+        return this->_stats.written + this->_stats.failed == this->_stats.submitted;
+    });
+}
+
+
+/** @brief Get writer counters
+ */
+CheckpointWriterStats CheckpointWriter::stats() {
+    lock_guard<mutex> lock(this->_mtx);
+    CheckpointWriterStats stats = this->_stats;
+    stats.pending = stats.submitted - stats.written - stats.failed;
+    return stats;
+}
+
+
+/** @brief Loop of writer thread: write checkpoints until the queue is closed
+ */
+void CheckpointWriter::_workerLoop() {
+    unique_ptr<Checkpoint> checkpoint;
+    while (this->_queue.pop(checkpoint)) {
+        bool ok = true;
+        bool is_new_base = false;
+        try {
+            this->_write(*checkpoint, is_new_base);
+        } catch (exception& e) {
+            cerr << "checkpoint " << checkpoint->capture.time << " not saved: " << e.what() << endl;
+            ok = false;
+        }
+        unique_ptr<Checkpoint> old_base;
+        if (ok && is_new_base) {
+            old_base = move(this->_base);
+            this->_base = move(checkpoint);
+        } else if (!ok) {
+            old_base = move(this->_base);  // next delta would be relative to a missing file
+        }
+        lock_guard<mutex> lock(this->_mtx);
+        if (ok)
+            this->_stats.written++;
+        else
+            this->_stats.failed++;
+        if (checkpoint)
+            this->_recycled.push_back(move(checkpoint));
+        if (old_base)
+            this->_recycled.push_back(move(old_base));
+        this->_cv_flushed.notify_all();
+    }
+}
+
+
+/** @brief Encode, compress and write a checkpoint to its files
+ *
+ * A checkpoint of the same time as the last binary or delta snapshot
+ * written (e.g. saved again on exit right after a periodic backup) is
+ * skipped, so a time slice never gets both a delta and a full snapshot.
+ *
+ * @param[in] checkpoint Checkpoint to be written
+ * @param[out] is_new_base Set to true if a binary or delta snapshot was written
+ */
+void CheckpointWriter::_write(const Checkpoint& checkpoint, bool& is_new_base) {
+    const EcosystemCapture* base = this->_base ? &this->_base->capture : nullptr;
+    if ((base != nullptr) && (base->time == checkpoint.capture.time))
+        return;
+    if (!checkpoint.zjson_path.empty()) {
+        // JSON text goes straight through the zlib compressor to the file
+        this->_writeFile(checkpoint.capture.time, checkpoint.zjson_path, [&checkpoint](ostream& out) {
+            bio::filtering_ostream compressed_out;
+            compressed_out.push(bio::zlib_compressor());
+            compressed_out.push(out);
+            checkpoint.capture.writeJson(compressed_out);
+            compressed_out.reset();  // flush compressor
+        });
+    }
+    if (!checkpoint.delta_path.empty() && (base != nullptr) && (base->time < checkpoint.capture.time)) {
+        this->_writeFile(checkpoint.capture.time, checkpoint.delta_path, [this, &checkpoint, base](ostream& out) {
+            this->_writeBinary(checkpoint, out, [&checkpoint, base](ostream& encoded) {
+                checkpoint.capture.writeDelta(encoded, *base);
+            });
+        });
+        is_new_base = true;
+    } else if (!checkpoint.binary_path.empty()) {
+        this->_writeFile(checkpoint.capture.time, checkpoint.binary_path, [this, &checkpoint](ostream& out) {
+            this->_writeBinary(checkpoint, out, [&checkpoint](ostream& encoded) {
+                checkpoint.capture.writeSnapshot(encoded);
+            });
+        });
+        is_new_base = true;
+    }
+}
+
+
+/** @brief Write a file atomically and record it in the manifest
+ *
+ * @param[in] time Time slice saved in the file
+ * @param[in] path Destination path
+ * @param[in] write Function writing file contents to a stream
+ */
+void CheckpointWriter::_writeFile(int time, const string& path, const function<void(ostream&)>& write) {
+    FileChecksum checksum = _writeFileAtomically(path, write);
+    if (this->_manifest != nullptr)
+        this->_manifest->append(time, path, checksum);
+}
+
+
+/** @brief Write a binary or delta snapshot, block-compressed if checkpoint asks for it
+ *
+ * @param[in] checkpoint Checkpoint being written
+ * @param[out] out Output file stream
+ * @param[in] encode Function writing the (uncompressed) snapshot to a stream
+ */
+void CheckpointWriter::_writeBinary(const Checkpoint& checkpoint, ostream& out, const function<void(ostream&)>& encode) {
+    if (checkpoint.compression_level <= 0) {
+        encode(out);
+        return;
+    }
+    vector<char> raw_data;
+    {
+        bio::filtering_ostream raw_out;
+        raw_out.push(bio::back_inserter(raw_data));
+        encode(raw_out);
+    }
+    if (!this->_compression_pool || (this->_compression_pool->size() != checkpoint.compression_threads))
+        this->_compression_pool.reset(new ThreadPool(checkpoint.compression_threads));
+    writeBlockCompressed(out, raw_data.data(), raw_data.size(), checkpoint.block_size,
+                         checkpoint.compression_level, *this->_compression_pool);
+}
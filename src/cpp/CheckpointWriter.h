@@ -0,0 +1,117 @@
+/** @file CheckpointWriter.h
+ * @brief Header of CheckpointWriter
+ *
+ * @ingroup core
+ */
+
+#ifndef CHECKPOINTWRITER_H_INCLUDED
+#define CHECKPOINTWRITER_H_INCLUDED
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "ecosystem.h"
+#include "BoundedQueue.h"
+#include "ThreadPool.h"
+#include "BackupManifest.h"
+
+using namespace std;
+
+
+/** @brief Ecosystem capture and the files where it must be saved
+ */
+struct Checkpoint {
+    EcosystemCapture capture;
+    /** @brief Destination of .zjson backup (empty if not wanted)
+    */
+    string zjson_path;
+    /** @brief Destination of binary snapshot (empty if not wanted)
+    */
+    string binary_path;
+    /** @brief Destination of delta snapshot, written instead of the binary
+    * snapshot when previous binary checkpoint is known (empty for keyframes)
+    */
+    string delta_path;
+    /** @brief zlib level of binary and delta snapshots (0 to write them uncompressed)
+    */
+    int compression_level;
+    size_t block_size;
+    int compression_threads;
+
+    Checkpoint() : compression_level(0), block_size(1 << 20), compression_threads(1) {}
+};
+
+/** @brief Counters of a CheckpointWriter
+ */
+struct CheckpointWriterStats {
+    uint64_t submitted;
+    uint64_t written;
+    uint64_t failed;
+    /** @brief Checkpoints waiting to be written (including the one being written)
+    */
+    uint64_t pending;
+    /** @brief Number of submit() calls which had to wait because the queue was full
+    */
+    uint64_t stalls;
+    /** @brief Time spent by submit() waiting for the writer
+    */
+    double stall_ms;
+};
+
+
+/** @brief Background thread encoding, compressing and writing checkpoints
+ *
+ * The simulation thread takes a Checkpoint with acquire(), captures the
+ * ecosystem into it and hands it over with submit(). Written checkpoints
+ * are recycled, so with a queue of capacity N at most N + 3 captures are
+ * alive: N queued, one being written, one being filled and the base of
+ * delta snapshots (see below). When the writer falls behind,
+ * submit() blocks until there is room in the queue, and this backpressure
+ * is reported by stats().
+ *
+ * Files are written to a temporary path, synced to disk and then renamed,
+ * so an interrupted write never leaves an incomplete backup.
+ *
+ * The last binary checkpoint written is kept as base of the next delta
+ * snapshot. Without a base (first checkpoint, or after a failure) the full
+ * snapshot is written instead. Binary and delta snapshots can be
+ * block-compressed (see BlockFileHeader), blocks being compressed in parallel.
+ *
+ * Every file written is recorded, with its size and checksum, in the
+ * BackupManifest given to the constructor (if any).
+ *
+ * @ingroup core
+ */
+class CheckpointWriter {
+public:
+    CheckpointWriter(size_t queue_capacity, BackupManifest* manifest = nullptr);
+    ~CheckpointWriter();
+    unique_ptr<Checkpoint> acquire();
+    void submit(unique_ptr<Checkpoint> checkpoint);
+    void flush();
+    CheckpointWriterStats stats();
+private:
+    BoundedQueue<unique_ptr<Checkpoint>> _queue;
+    vector<unique_ptr<Checkpoint>> _recycled;
+    /** @brief Last binary checkpoint written (only used by writer thread)
+    */
+    unique_ptr<Checkpoint> _base;
+    /** @brief Threads compressing blocks (only used by writer thread)
+    */
+    unique_ptr<ThreadPool> _compression_pool;
+    BackupManifest* _manifest;
+    mutex _mtx;
+    condition_variable _cv_flushed;
+    CheckpointWriterStats _stats;
+    thread _worker;
+    void _workerLoop();
+    void _write(const Checkpoint& checkpoint, bool& is_new_base);
+    void _writeFile(int time, const string& path, const function<void(ostream&)>& write);
+    void _writeBinary(const Checkpoint& checkpoint, ostream& out, const function<void(ostream&)>& encode);
+};
+
+
+#endif  // CHECKPOINTWRITER_H_INCLUDED
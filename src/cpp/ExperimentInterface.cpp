@@ -6,7 +6,6 @@
 
 
 #include "ExperimentInterface.h"
-#include <regex>
 #include <stdlib.h>
 #include <algorithm>
 #include <iterator>
@@ -16,10 +15,22 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <thread>
+#include "BlockCompression.h"
+#include "FrameArchive.h"
 
 namespace bf=boost::filesystem;
 namespace bio=boost::iostreams;
 
+/** @brief Backups waiting to be written before saveEcosystem() blocks
+ */
+const size_t BACKUP_QUEUE_CAPACITY = 1;
+
+/** @brief Frames waiting to be streamed before they are dropped
+ */
+const size_t FRAME_STREAM_QUEUE_CAPACITY = 8;
+
 
 void split(const string &s, char delim, vector<string> &elems) {
     stringstream ss(s);
@@ -57,7 +68,30 @@ fs::path stringToPath(string path_str) {
 }
 
 
+/** @brief Get the folder of a time slice, relative to experiment folder
+ *
+ * Files are spread over two levels of folders, millions and thousands of
+ * time slice, e.g. time slice 12345678 goes to "012/345", so no folder
+ * holds more than 1000 time slices.
+ *
+ * @param[in] time_slice Time slice
+ *
+ * @returns Relative path of folder
+ */
+string getThousandsFolder(int time_slice) {
+    char millions_formatted[16];
+    char thousands_formatted[16];
+    snprintf(millions_formatted, sizeof(millions_formatted), "%03d", (time_slice / 1000000) % 1000);
+    snprintf(thousands_formatted, sizeof(thousands_formatted), "%03d", (time_slice / 1000) % 1000);
+    return (fs::path(millions_formatted) / fs::path(thousands_formatted)).string();
+}
+
+
 /** @brief Get path of file containing ecosystem data
+ *
+ * Files go to the folder given by getThousandsFolder(). The disk is not
+ * accessed: code reading files must use findEcosystemFile() to read
+ * experiments saved with the old layout.
  *
  * @param[in] dst_path Path of destination folder
  * @param[in] time_slice Time slice for which ecosystem data will be get
@@ -70,11 +104,32 @@ string getEcosystemGenericPath(fs::path dst_path, int time_slice, string file_ex
     sprintf(time_slice_formatted, "%08d", time_slice);
     dst_file_name << "bk_"<< time_slice_formatted << file_extension;
     fs::path dst_file =  (dst_path /
+                         fs::path(getThousandsFolder(time_slice)) /
                          fs::path(dst_file_name.str()));
     return dst_file.string();
 }
 
 
+/** @brief Find a file of ecosystem data to be read
+ *
+ * Experiments saved before thousands folders existed have all files in
+ * the experiment folder: if the file doesn't exist in its thousands
+ * folder but exists there, that path is returned instead.
+ *
+ * @param[in] dst_path Path of destination folder
+ * @param[in] ecosystem_file Path given by getEcosystemGenericPath()
+ *
+ * @returns Path of file
+ */
+string findEcosystemFile(fs::path dst_path, string ecosystem_file) {
+    if (!fs::exists(ecosystem_file)) {
+        fs::path flat_file = dst_path / fs::path(ecosystem_file).filename();
+        if (fs::exists(flat_file))
+            return flat_file.string();
+    }
+    return ecosystem_file;
+}
+
 
 /** @brief Get path of JSON containing ecosystem data
  *
@@ -88,6 +143,41 @@ string getEcosystemJSONPath(fs::path dst_path, int time_slice) {
 }
 
 
+/** @brief Get path of binary snapshot containing ecosystem data
+ *
+ * @param[in] dst_path Path of destination folder
+ * @param[in] time_slice Time slice for which ecosystem data will be get
+ *
+ * @returns Path of binary snapshot file
+ */
+string getEcosystemBinaryPath(fs::path dst_path, int time_slice) {
+    return getEcosystemGenericPath(dst_path, time_slice, ".ecobin");
+}
+
+
+/** @brief Get path of delta snapshot containing ecosystem data
+ *
+ * @param[in] dst_path Path of destination folder
+ * @param[in] time_slice Time slice for which ecosystem data will be get
+ *
+ * @returns Path of delta snapshot file
+ */
+string getEcosystemDeltaPath(fs::path dst_path, int time_slice) {
+    return getEcosystemGenericPath(dst_path, time_slice, ".ecodelta");
+}
+
+
+/** @brief Get path of the frame archive of an experiment
+ *
+ * @param[in] dst_path Path of destination folder
+ *
+ * @returns Path of frame archive file
+ */
+string getFrameArchivePath(fs::path dst_path) {
+    return (dst_path / fs::path("frames.ecoframes")).string();
+}
+
+
 /** @brief Get path of TGA containing ecosystem data
  *
  * @param[in] dst_path Path of destination folder
@@ -145,21 +235,55 @@ void decompressData(stringstream &compressed, stringstream &decompressed)
 /** @brief Initializer
  *
  * @param[in] experiment_folder String with experiment_folder path
+ * @param[in] overwrite Start a new experiment even if there are backups
+ * @param[in] constants Constants replacing the default ones in a new
+ * experiment. Only those read by compileSettings() are taken into
+ * account (e.g. DRAWING_FORMAT), not the ones used to create the biotope
+ * and the initial organisms
  */
 ExperimentInterface::ExperimentInterface(string experiment_folder,
-                                         bool overwrite) {
+                                         bool overwrite, const json& constants) {
     _setExperimentFolder(experiment_folder);
+    _manifest.reset(new BackupManifest(_dst_path));
+    if (!_manifest->exists())
+        _manifest->rebuild();  // experiment saved before manifests existed
+    _checkpoint_writer.reset(new CheckpointWriter(BACKUP_QUEUE_CAPACITY, _manifest.get()));
     vector<int> timesHavingCompleteBackups = getTimesHavingCompleteBackups();
     if (timesHavingCompleteBackups.size() == 0)
         overwrite = true;
     _ecosystem = new Ecosystem();
     if (overwrite) {
+        if (!constants.empty()) {
+            for (auto it = constants.begin(); it != constants.end(); ++it)
+                _ecosystem->settings_json["constants"][it.key()] = it.value();
+            _ecosystem->compileSettings();
+        }
         _cleanFolder();
 	drawEcosystem();
         saveEcosystem();  // _ecosystem->time is 0, so we save initial settings
     } else {
-        loadEcosystem(timesHavingCompleteBackups.back());
+        _loadLastBackup(timesHavingCompleteBackups);
+    }
+}
+
+
+/** @brief Load the most recent backup that can be read
+ *
+ * A backup that fails to load (e.g. corrupted, or a delta snapshot whose
+ * chain is broken) is reported and the previous one is tried.
+ *
+ * @param[in] times Times having complete backups, in increasing order
+ */
+void ExperimentInterface::_loadLastBackup(const vector<int>& times) {
+    for (auto it = times.rbegin(); it != times.rend(); ++it) {
+        try {
+            loadEcosystem(*it);
+            return;
+        } catch (exception& e) {
+            cerr << "backup at time " << *it << " not loaded: " << e.what() << endl;
+        }
     }
+    throw runtime_error("no backup can be loaded in " + _dst_path.string());
 }
 
 
@@ -206,113 +330,311 @@ void ExperimentInterface::unlockEcosystem() {
 
 
 /** @brief Save current time slice to disk
+ *
+ * Only the capture of the ecosystem state is done here: encoding,
+ * compression and writing are done in background by _checkpoint_writer
+ * (call waitForBackups() to wait for them). Formats written (.zjson
+ * and/or binary) are set by constant BACKUP_FORMAT. Binary backups are
+ * full snapshots (.ecobin) at multiples of BACKUP_KEYFRAME_PERIOD, and
+ * delta snapshots (.ecodelta) otherwise.
  */
 void ExperimentInterface::saveEcosystem() {
-    // get file name
     int curr_time = _ecosystem->time;
-    string dst_file = getEcosystemJSONPath(_dst_path, curr_time);
-    
-    json data_json;
-    _ecosystem->serialize(data_json);
-    stringstream data_uncompressed;
-    stringstream data_compressed;
-    data_uncompressed << data_json;
-    compressData(data_uncompressed, data_compressed);
-
-    // export data
-    ofstream f_data;
-    f_data.open(dst_file, ios::out);
-    f_data << data_compressed.rdbuf();
-    f_data.close();
-}
-
-
-TGAColor organismToColour(Organism* o) {
-    string ORGANISM_TYPE = o->species;
-    float r = 0.0f;
-    float g = 0.0f;
-    float b = 0.0f;
-    float a = 1.0f;
+    unsigned int backup_formats = _ecosystem->getCompiledSettings().backup_formats;
+
+    unique_ptr<Checkpoint> checkpoint = _checkpoint_writer->acquire();
+    _ecosystem->capture(checkpoint->capture);
+    checkpoint->zjson_path = (backup_formats & BACKUP_ZJSON) ? getEcosystemJSONPath(_dst_path, curr_time) : "";
+    checkpoint->binary_path = (backup_formats & BACKUP_BINARY) ? getEcosystemBinaryPath(_dst_path, curr_time) : "";
+    bool is_keyframe = (curr_time % _ecosystem->getCompiledSettings().backup_keyframe_period == 0);
+    checkpoint->delta_path = ((backup_formats & BACKUP_BINARY) && !is_keyframe) ? getEcosystemDeltaPath(_dst_path, curr_time) : "";
+    checkpoint->compression_level = _ecosystem->getCompiledSettings().backup_compression_level;
+    checkpoint->block_size = _ecosystem->getCompiledSettings().backup_block_size;
+    checkpoint->compression_threads = _ecosystem->getCompiledSettings().backup_compression_threads;
+    _checkpoint_writer->submit(move(checkpoint));
+}
+
+
+/** @brief Wait until all backups requested by saveEcosystem() are on disk
+ */
+void ExperimentInterface::waitForBackups() {
+    _checkpoint_writer->flush();
+}
+
+
+/** @brief Get counters of background backups (written, pending, stalls...)
+ */
+CheckpointWriterStats ExperimentInterface::getBackupStats() {
+    return _checkpoint_writer->stats();
+}
+
+
+/** @brief Get counters of streamed video frames (written, dropped)
+ */
+FrameStreamStats ExperimentInterface::getFrameStreamStats() {
+    lock_guard<mutex> lock(_output_mtx);
+    if (!_frame_stream)
+        return FrameStreamStats();
+    return _frame_stream->stats();
+}
+
+
+/** @brief Get base colour of a species, given its name
+ *
+ * @param[in] species_name Species name, e.g. "P"
+ * @returns RGB colour (components in [0, 1]), black for unknown species
+ */
+SpeciesColour speciesToColour(const string& species_name) {
+    string ORGANISM_TYPE = species_name;
+    SpeciesColour c = {0.0f, 0.0f, 0.0f};
     if (ORGANISM_TYPE == "P") {
         // green
-        r = 0.0f;
-        g = 1.0f;
-        b = 0.0f;
+        c.r = 0.0f;
+        c.g = 1.0f;
+        c.b = 0.0f;
     } else if (ORGANISM_TYPE == "H1") {
         // grey
-        r = 0.5f;
-        g = 0.5f;
-        b = 0.5f;
+        c.r = 0.5f;
+        c.g = 0.5f;
+        c.b = 0.5f;
     } else if (ORGANISM_TYPE == "H2") {
         // blue
-        r = 0.2f;
-        g = 0.2f;
-        b = 1.0f;
+        c.r = 0.2f;
+        c.g = 0.2f;
+        c.b = 1.0f;
     } else if (ORGANISM_TYPE == "C1") {
         // red
-        r = 1.0f;
-        g = 0.0f;
-        b = 0.0f;
+        c.r = 1.0f;
+        c.g = 0.0f;
+        c.b = 0.0f;
     } else if (ORGANISM_TYPE == "C2") {
         // orange
-        r = 1.0f;
-        g = 0.5f;
-        b = 0.0f;
+        c.r = 1.0f;
+        c.g = 0.5f;
+        c.b = 0.0f;
     } else if (ORGANISM_TYPE == "C3") {
         // light blue
-        r = 0.0f;
-        g = 0.5f;
-        b = 1.0f;
+        c.r = 0.0f;
+        c.g = 0.5f;
+        c.b = 1.0f;
     }
-    float energy_ratio = (float)o->energy_reserve / o->initial_energy_reserve;
-    float age_ratio = 1.0f - (float)o->age / o->death_age;
-    a = 0.5 * energy_ratio * age_ratio;
-    r *= a;
-    g *= a;
-    b *= a;
-    return TGAColor(
-        (unsigned char)(r * 255),
-        (unsigned char)(g * 255),
-        (unsigned char)(b * 255));
+    return c;
 }
 
 
 /** @brief Draw current time slice to TGA image into disk
+ *
+ * Only the capture of the biotope (a palette index per cell) is done
+ * here: rendering and writing are done in background by _render_thread
+ * (call waitForFrames() to wait for them). If the renderer lags behind,
+ * the frame waits or is dropped as set by constant DRAWING_QUEUE.
+ *
+ * If constant DRAWING_INCREMENTAL is true, frames after the first one
+ * only repaint the cells whose colour changed (see captureChangedCells()).
  */
 void ExperimentInterface::drawEcosystem() {
-    // get file name
-    int zoom_factor = getDrawingZoomFactor();
-    int curr_time = _ecosystem->time;
+    const CompiledSettings& settings = _ecosystem->getCompiledSettings();
+    if (!_render_thread)
+        _render_thread.reset(new RenderThread(
+            settings.drawing_queue_capacity,
+            settings.drawing_drop_frames ? RENDER_QUEUE_DROP : RENDER_QUEUE_BLOCK,
+            [this](const FrameCapture& capture, TGAImage& frame) { this->_writeFrame(capture, frame); }));
+    unique_ptr<FrameCapture> capture = _render_thread->acquire();
+    if (settings.drawing_incremental && ((int)_drawn_cells.size() == _ecosystem->biotope.numCells())) {
+        captureChangedCells(*_ecosystem, _getPalette(), _drawn_cells, *capture);
+    } else {
+        captureFrame(*_ecosystem, _getPalette(), *capture);
+        _ecosystem->biotope_changes.clear();
+        if (settings.drawing_incremental)
+            _drawn_cells = capture->cells;
+    }
+    capture->zoom_factor = settings.drawing_zoom_factor;
+    capture->drawing_format = settings.drawing_format;
+    capture->drawing_stream_path = settings.drawing_stream_path;
+    capture->drawing_stream_fps = settings.drawing_stream_fps;
+    capture->drawing_encoder_threads = settings.drawing_encoder_threads;
+    _render_thread->submit(move(capture));
+}
+
+
+/** @brief Write a rendered frame (called from render thread)
+ *
+ * Depending on DRAWING_FORMAT, the image is written to its own .tga file,
+ * appended to the frame archive of the experiment or streamed as video
+ * (frames are dropped if the consumer doesn't keep up).
+ *
+ * @param[in] capture Capture the frame was rendered from
+ * @param[in] frame Rendered frame
+ */
+void ExperimentInterface::_writeFrame(const FrameCapture& capture, TGAImage& frame) {
+    int curr_time = capture.time;
+    if ((capture.drawing_format == DRAWING_Y4M) || (capture.drawing_format == DRAWING_RGB)) {
+        lock_guard<mutex> lock(_output_mtx);
+        if (!_frame_stream)
+            _frame_stream.reset(new FrameStream(
+                capture.drawing_stream_path,
+                (capture.drawing_format == DRAWING_Y4M) ? FRAME_STREAM_Y4M : FRAME_STREAM_RGB,
+                frame.get_width(), frame.get_height(), capture.drawing_stream_fps,
+                FRAME_STREAM_QUEUE_CAPACITY));
+        size_t frame_size = (size_t)frame.get_width() * frame.get_height() * frame.get_bytespp();
+        vector<uint8_t> bgr_frame = _frame_stream->acquire();
+        bgr_frame.assign(frame.buffer(), frame.buffer() + frame_size);
+        _frame_stream->push(move(bgr_frame));
+        return;
+    }
+    if (!_encoding_pool || (_encoding_pool->size() != capture.drawing_encoder_threads))
+        _encoding_pool.reset(new ThreadPool(capture.drawing_encoder_threads));
+    if (capture.drawing_format == DRAWING_ARCHIVE) {
+        vector<char>& frame_bytes = _frame_bytes;  // reused between frames
+        frame_bytes.clear();
+        {
+            bio::filtering_ostream frame_data;
+            frame_data.push(bio::back_inserter(frame_bytes));
+            frame.write_tga(frame_data, true, _encoding_pool.get());
+        }
+        string archive_file = getFrameArchivePath(_dst_path);
+        lock_guard<mutex> lock(_output_mtx);
+        bool opening = !_frame_archive;
+        if (opening)
+            _frame_archive.reset(new FrameArchiveWriter(archive_file));
+        _frame_archive->append(curr_time, frame_bytes.data(), frame_bytes.size());
+        if (opening) {  // frames themselves are listed by the archive index
+            FileChecksum archive_size;  // no crc32: it would be stale after the next append
+            archive_size.bytes = fs::file_size(archive_file);
+            _manifest->append(curr_time, archive_file, archive_size);
+        }
+        return;
+    }
     string dst_file = getEcosystemTGAPath(_dst_path, curr_time);
-    TGAImage frame(_ecosystem->biotope_size_x * zoom_factor,
-                   _ecosystem->biotope_size_y * zoom_factor,
-                   TGAImage::RGB);
-    for (auto o:_ecosystem->biotope) {
-        tuple<int, int> position = o.first;
-        string ORGANISM_TYPE = o.second->species;
-        int x = get<0>(position);
-        int y = get<1>(position);
-        TGAColor color_o = organismToColour(o.second);
-	for (int fx=0; fx<zoom_factor; fx++)
-	    for (int fy=0; fy<zoom_factor; fy++)
-                frame.set(zoom_factor*x+fx, zoom_factor*y+fy, color_o);
+    fs::create_directories(fs::path(dst_file).parent_path());
+    ofstream f_frame(dst_file, ios::out | ios::binary);
+    if (!f_frame.is_open()) {
+        cerr << "can't open file " << dst_file << endl;
+        return;
     }
-    frame.write_tga_file(dst_file.c_str());
+    FileChecksum checksum;  // computed while writing, so the image isn't read back
+    bool written;
+    {
+        bio::filtering_ostream checked_out;
+        checked_out.push(ChecksumFilter(checksum));
+        checked_out.push(f_frame);
+        written = frame.write_tga(checked_out, true, _encoding_pool.get());
+        checked_out.flush();
+        written = written && !checked_out.fail();
+    }
+    f_frame.close();
+    if (written && !f_frame.fail())
+        _manifest->append(curr_time, dst_file, checksum);
+}
+
+
+/** @brief Get the colour palette of the running ecosystem (built the first time)
+ */
+shared_ptr<const ColourPalette> ExperimentInterface::_getPalette() {
+    if (!_palette) {
+        vector<SpeciesColour> species_colours;
+        for (const string& species_name : _ecosystem->getCompiledSettings().species.names())
+            species_colours.push_back(speciesToColour(species_name));
+        _palette = make_shared<const ColourPalette>(species_colours);
+    }
+    return _palette;
+}
+
+
+/** @brief Get the size in bytes of a frame of the running ecosystem (see renderFrameInto())
+ */
+size_t ExperimentInterface::getFrameSize() {
+    size_t zoom_factor = getDrawingZoomFactor();
+    return (_ecosystem->biotope_size_x * zoom_factor) * (_ecosystem->biotope_size_y * zoom_factor) * 3;
+}
+
+
+/** @brief Draw current time slice into memory given by the caller
+ *
+ * Unlike drawEcosystem(), the frame is rendered right away (in the
+ * calling thread) and nothing is written to disk. The caller can pass
+ * any memory, e.g. shared with another process, so no image is allocated.
+ *
+ * @param[out] bgr_frame Frame pixels (3 bytes: blue, green, red), top row first
+ * @param[in] size Bytes available at bgr_frame, at least getFrameSize()
+ */
+void ExperimentInterface::renderFrameInto(uint8_t* bgr_frame, size_t size) {
+    if (size < getFrameSize())
+        throw invalid_argument("frame buffer of " + to_string(size) + " bytes, "
+                               + to_string(getFrameSize()) + " needed");
+    captureFrame(*_ecosystem, _getPalette(), _frame_capture);
+    _frame_capture.zoom_factor = getDrawingZoomFactor();
+    renderFrame(_frame_capture, bgr_frame);
+}
+
+
+/** @brief Wait until all frames requested by drawEcosystem() are drawn
+ * and, when streamed, written to the stream
+ */
+void ExperimentInterface::waitForFrames() {
+    if (_render_thread)
+        _render_thread->flush();
+    lock_guard<mutex> lock(_output_mtx);
+    if (_frame_stream)
+        _frame_stream->flush();
+}
+
+
+/** @brief Get counters of background rendering (rendered, dropped, pending...)
+ */
+RenderThreadStats ExperimentInterface::getRenderStats() {
+    if (!_render_thread)
+        return RenderThreadStats();
+    return _render_thread->stats();
+}
+
+
+/** @brief Write the frames of the frame archive as .tga files
+ *
+ * @returns Number of frames written
+ */
+int ExperimentInterface::exportFramesToTGA() {
+    waitForFrames();
+    string archive_file = getFrameArchivePath(_dst_path);
+    if (!fs::exists(archive_file))
+        return 0;
+    FrameArchiveReader archive(archive_file);
+    vector<char> frame_bytes;
+    int num_frames = 0;
+    for (int time_slice : archive.times()) {
+        archive.read(time_slice, frame_bytes);
+        string dst_file = getEcosystemTGAPath(_dst_path, time_slice);
+        fs::create_directories(fs::path(dst_file).parent_path());
+        ofstream f_frame(dst_file, ios::out | ios::binary);
+        f_frame.write(frame_bytes.data(), frame_bytes.size());
+        f_frame.close();
+        if (f_frame.fail())
+            throw runtime_error("can't write " + dst_file);
+        FileChecksum checksum;
+        checksum.process(frame_bytes.data(), frame_bytes.size());
+        _manifest->append(time_slice, dst_file, checksum);
+        num_frames++;
+    }
+    return num_frames;
 }
 
 
 /* @brief Get experiment size in MBs in format e.g. "321.16MB"
+ *
+ * Sizes are taken from the manifest, not from the folder, except for the
+ * frame archive, which keeps growing after it is recorded.
  *
  * @returns String with experiment size
  */
 string ExperimentInterface::getExperimentSize() {
     double size = 0.0;
-    for(bf::recursive_directory_iterator it(_dst_path);
-        it!=bf::recursive_directory_iterator();
-        ++it)
-    {
-        if(!is_directory(*it))
-            size+=bf::file_size(*it);
+    for (const ManifestEntry& entry : _manifest->entries()) {
+        if (entry.kind == "ecoframes") {
+            fs::path archive_file = _dst_path / entry.path;
+            size += fs::exists(archive_file) ? fs::file_size(archive_file) : entry.bytes;
+        } else {
+            size += entry.bytes;
+        }
     }
     double _directory_size = size / 1000000;
     return to_string_with_precision(_directory_size, 2);
@@ -348,56 +670,137 @@ string ExperimentInterface::getExperimentFolder() {
 /** @brief Delete content of experiment folder
  */
 void ExperimentInterface::_cleanFolder() {
+    waitForBackups();
+    waitForFrames();
+    {
+        lock_guard<mutex> lock(_output_mtx);
+        _frame_archive.reset();
+    }
     fs::remove_all(_dst_path);
     fs::create_directory(_dst_path);
 }
 
 /** @brief Load a given time slice into ecosystem object
+ *
+ * The ecosystem is only replaced once the backup is completely read: if
+ * it can't be loaded an exception is thrown and the current ecosystem is
+ * kept.
  *
  * @param[in] time_slice Time value to load
  */
 void ExperimentInterface::loadEcosystem(int time_slice) {
-    lockEcosystem();
+    waitForBackups();
+    unique_ptr<Ecosystem> loaded(_readEcosystem(time_slice));
+    lock_guard<mutex> lock(_mtx);
     delete _ecosystem;
-    
-    // load json file
+    _ecosystem = loaded.release();
+    _palette.reset();  // species may change
+    _drawn_cells.clear();  // next frame is drawn in full
+}
+
+/** @brief Build an ecosystem from the backup of a given time slice
+ *
+ * The binary snapshot is preferred if there is one: it is mapped in memory
+ * and organisms are built straight from the mapped columns (or from its
+ * blocks, decompressed in parallel, if it is block-compressed). Then a delta
+ * snapshot, applied to its chain of previous checkpoints, and finally the
+ * .zjson backup.
+ *
+ * @param[in] time_slice Time value to load
+ * @returns New ecosystem, to be deleted by the caller
+ */
+Ecosystem* ExperimentInterface::_readEcosystem(int time_slice) {
+    ThreadPool decompression_pool(max(1, (int)thread::hardware_concurrency()));
+    string binary_file = findEcosystemFile(_dst_path, getEcosystemBinaryPath(_dst_path, time_slice));
+    if (fs::exists(binary_file)) {
+        DecodedFile snapshot_file(binary_file, decompression_pool);
+        return new Ecosystem(SnapshotView(snapshot_file.data(), snapshot_file.size()));
+    }
+    if (fs::exists(findEcosystemFile(_dst_path, getEcosystemDeltaPath(_dst_path, time_slice)))) {
+        EcosystemCapture capture;
+        _loadCapture(time_slice, capture, decompression_pool);
+        return new Ecosystem(capture);
+    }
+
+    // load json file, decompressed while it is parsed
+    string json_file = findEcosystemFile(_dst_path, getEcosystemJSONPath(_dst_path, time_slice));
     ifstream f_data_json;
-    f_data_json.open(getEcosystemJSONPath(_dst_path, time_slice));
-    stringstream compressed;
-    stringstream decompressed;
-    compressed << f_data_json.rdbuf();
-    decompressData(compressed, decompressed);
+    f_data_json.open(json_file, ios::in | ios::binary);
+    if (!f_data_json.is_open())
+        throw runtime_error("can't open backup at time " + to_string(time_slice) + ": " + json_file);
+    bio::filtering_istream decompressed;
+    decompressed.push(bio::zlib_decompressor());
+    decompressed.push(f_data_json);
     json data_json;
     decompressed >> data_json;
+    decompressed.reset();
     f_data_json.close();
-    _ecosystem = new Ecosystem(data_json);
-    unlockEcosystem();
+    return new Ecosystem(data_json);
+}
+
+/** @brief Get the header of a delta snapshot (raw or block-compressed) without reading it all
+ *
+ * @param[in] delta_file Path of delta snapshot
+ */
+static DeltaHeader _readDeltaHeader(const string& delta_file) {
+    MappedFile mapped_delta(delta_file);
+    DeltaHeader header;
+    if (isBlockCompressed(mapped_delta.data(), mapped_delta.size())) {
+        BlockCompressedView view(mapped_delta.data(), mapped_delta.size());
+        if (view.rawSize() < sizeof(DeltaHeader))
+            throw runtime_error("not an ecosystem delta snapshot: " + delta_file);
+        view.read(0, sizeof(DeltaHeader), reinterpret_cast<char*>(&header));  // first block only
+    } else {
+        header = DeltaView(mapped_delta.data(), mapped_delta.size()).header();
+    }
+    return header;
+}
+
+/** @brief Rebuild ecosystem state at a given time from binary and delta snapshots
+ *
+ * Deltas are followed back to the nearest full snapshot, which is then
+ * moved forward applying them in order.
+ *
+ * @param[in] time_slice Time value to load
+ * @param[out] capture Ecosystem state at time_slice
+ * @param[in] pool Threads decompressing blocks of compressed snapshots
+ */
+void ExperimentInterface::_loadCapture(int time_slice, EcosystemCapture& capture, ThreadPool& pool) {
+    vector<int> delta_times;
+    int keyframe_time = time_slice;
+    while (!fs::exists(findEcosystemFile(_dst_path, getEcosystemBinaryPath(_dst_path, keyframe_time)))) {
+        string delta_file = findEcosystemFile(_dst_path, getEcosystemDeltaPath(_dst_path, keyframe_time));
+        if (!fs::exists(delta_file))
+            throw runtime_error("no binary nor delta snapshot at time " + to_string(keyframe_time));
+        delta_times.push_back(keyframe_time);
+        keyframe_time = _readDeltaHeader(delta_file).base_time;
+    }
+    {
+        DecodedFile snapshot_file(findEcosystemFile(_dst_path, getEcosystemBinaryPath(_dst_path, keyframe_time)), pool);
+        capture.readSnapshot(SnapshotView(snapshot_file.data(), snapshot_file.size()));
+    }
+    for (auto it = delta_times.rbegin(); it != delta_times.rend(); ++it) {
+        DecodedFile delta_file(findEcosystemFile(_dst_path, getEcosystemDeltaPath(_dst_path, *it)), pool);
+        capture.applyDelta(DeltaView(delta_file.data(), delta_file.size()));
+    }
 }
 
 /** @brief Get a list of time slices containing a complete backup of ecosystem
+ *
+ * Backups are listed from the manifest, not from the folder, but entries
+ * whose file is no longer in the folder (e.g. deleted by hand) are skipped.
  *
  * @returns List of time slices allowing complete backup
  */
 vector<int> ExperimentInterface::getTimesHavingCompleteBackups() {
-    // TODO: Do it with a vector.
     vector<int> times;
-    for(bf::recursive_directory_iterator it(_dst_path);
-        it!=bf::recursive_directory_iterator();
-        ++it)
-    {
-        if(!is_directory(*it)) {
-            string path = (*it).path().string();
-            std::string result;
-            std::regex re("/bk_(\\d+)\\.zjson");
-            std::smatch match;
-            if (std::regex_search(path, match, re) && match.size() > 1) {
-                result = match.str(1);
-                int json_num = atoi(result.c_str());
-                times.push_back(json_num);
-            }
-        }
+    for (const ManifestEntry& entry : _manifest->entries()) {
+        if ((entry.kind != "zjson") && (entry.kind != "ecobin") && (entry.kind != "ecodelta"))
+            continue;
+        if (fs::exists(_dst_path / entry.path))
+            times.push_back(entry.time);
     }
-    sort(times.begin(), times.end());
+    times.erase(unique(times.begin(), times.end()), times.end());  // several formats
     return times;
 }
 
@@ -413,17 +816,17 @@ int ExperimentInterface::getRunningTime() {
 /** @brief Get backup period
  */
 int ExperimentInterface::getDrawingZoomFactor() {
-    return (*getSettings_json_ptr())["constants"]["DRAWING_ZOOM_FACTOR"];
+    return _ecosystem->getCompiledSettings().drawing_zoom_factor;
 }
 
 /** @brief Get drawing period
  */
 int ExperimentInterface::getDrawingPeriod() {
-    return (*getSettings_json_ptr())["constants"]["DRAWING_PERIOD"];
+    return _ecosystem->getCompiledSettings().drawing_period;
 }
 
 /** @brief Get backup period
  */
 int ExperimentInterface::getBackupPeriod() {
-    return (*getSettings_json_ptr())["constants"]["BACKUP_PERIOD"];
+    return _ecosystem->getCompiledSettings().backup_period;
 }
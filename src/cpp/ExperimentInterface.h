@@ -10,6 +10,12 @@
 #include <mutex>
 #include "ecosystem.h"
 #include "tgaimage.hpp"
+#include "CheckpointWriter.h"
+#include "BackupManifest.h"
+#include "FrameArchive.h"
+#include "FrameStream.h"
+#include "FrameRenderer.h"
+#include "RenderThread.h"
 #include <boost/filesystem.hpp>
 
 using namespace std;
@@ -19,12 +25,16 @@ using namespace std;
 void decompressData(stringstream &compressed, stringstream &decompressed);
 void compressData(stringstream &decompressed, stringstream &compressed);
 bool experimentAlreadyExists(string experiment_folder);
-string getEcosystemGenericPath(fs::path dst_path, int time_slice);
+string getEcosystemGenericPath(fs::path dst_path, int time_slice, string file_extension);
+string findEcosystemFile(fs::path dst_path, string ecosystem_file);
 string getEcosystemTGAPath(fs::path dst_path, int time_slice);
 string getEcosystemJSONPath(fs::path dst_path, int time_slice);
+string getEcosystemBinaryPath(fs::path dst_path, int time_slice);
+string getEcosystemDeltaPath(fs::path dst_path, int time_slice);
+string getFrameArchivePath(fs::path dst_path);
 string getThousandsFolder(int time_slice);
 fs::path stringToPath(string path_str);
-TGAColor organismToColour(Organism* o);
+SpeciesColour speciesToColour(const string& species_name);
 template <typename T>
 std::string to_string_with_precision(const T a_value, const int n);
 
@@ -37,14 +47,22 @@ std::string to_string_with_precision(const T a_value, const int n);
  */
 class ExperimentInterface {
 public:
-    ExperimentInterface(string experiment_folder, bool overwrite);
+    ExperimentInterface(string experiment_folder, bool overwrite, const json& constants = json::object());
     void evolve();
     Ecosystem* getEcosystemPointer();
     void lockEcosystem();
     bool tryLockEcosystem();
     void unlockEcosystem();
     void saveEcosystem();
+    void waitForBackups();
+    CheckpointWriterStats getBackupStats();
     void drawEcosystem();
+    int exportFramesToTGA();
+    FrameStreamStats getFrameStreamStats();
+    size_t getFrameSize();
+    void renderFrameInto(uint8_t* bgr_frame, size_t size);
+    void waitForFrames();
+    RenderThreadStats getRenderStats();
     void loadEcosystem(int time_slice);
     json* getSettings_json_ptr();
     string getExperimentFolder();
@@ -60,8 +78,34 @@ private:
     fs::path _dst_path;
     string _experiment_name;
     Ecosystem* _ecosystem;
+    unique_ptr<BackupManifest> _manifest;
+    unique_ptr<CheckpointWriter> _checkpoint_writer;
+    unique_ptr<FrameArchiveWriter> _frame_archive;
+    unique_ptr<FrameStream> _frame_stream;
+    /** @brief Guards _frame_archive and _frame_stream, used by render thread
+    */
+    mutex _output_mtx;
+    shared_ptr<const ColourPalette> _palette;
+    /** @brief Palette index of each cell in the last capture submitted by drawEcosystem()
+    */
+    vector<PaletteIndex> _drawn_cells;
+    /** @brief Capture used by renderFrameInto()
+    */
+    FrameCapture _frame_capture;
+    /** @brief Encoded frame appended to frame archive (only used by render thread)
+    */
+    vector<char> _frame_bytes;
+    /** @brief Threads run-length encoding frames (only used by render thread)
+    */
+    unique_ptr<ThreadPool> _encoding_pool;
+    unique_ptr<RenderThread> _render_thread;
     void _setExperimentFolder(string experiment_folder);
     void _cleanFolder();
+    shared_ptr<const ColourPalette> _getPalette();
+    void _writeFrame(const FrameCapture& capture, TGAImage& frame);
+    void _loadCapture(int time_slice, EcosystemCapture& capture, ThreadPool& pool);
+    Ecosystem* _readEcosystem(int time_slice);
+    void _loadLastBackup(const vector<int>& times);
 };
 
 
@@ -0,0 +1,177 @@
+/** @file FrameArchive.cpp
+ * @brief Frame archives definition
+ *
+ * @ingroup core
+ */
+
+#include "FrameArchive.h"
+#include <cstring>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include "Snapshot.h"
+
+namespace fs = boost::filesystem;
+
+
+/** @brief Get path of the index of a frame archive
+ *
+ * @param[in] archive_path Path of frame archive
+ */
+string getFrameIndexPath(const string& archive_path) {
+    return archive_path + ".index";
+}
+
+
+/** @brief Fill a header with the given magic and current version and byte order
+ */
+static FrameArchiveHeader _makeHeader(const char* magic) {
+    FrameArchiveHeader header;
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = FRAME_ARCHIVE_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    return header;
+}
+
+
+/** @brief Read and check the header of a frame archive or index
+ *
+ * @param[in] in Stream at the beginning of the file
+ * @param[in] magic Expected magic
+ * @param[in] path Path of file (for error messages)
+ */
+static void _readHeader(istream& in, const char* magic, const string& path) {
+    FrameArchiveHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || memcmp(header.magic, magic, sizeof(header.magic)) != 0)
+        throw runtime_error("not a frame archive: " + path);
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER)
+        throw runtime_error("frame archive written with another byte order: " + path);
+    if (header.version != FRAME_ARCHIVE_VERSION)
+        throw runtime_error("unsupported frame archive version: " + path);
+}
+
+
+/*********************************************************
+ * FrameArchiveWriter implementation
+ ********************************************************/
+
+/** @brief Initializer: open (or create) a frame archive to append frames
+ *
+ * Bytes after the last frame of the index (a frame whose write was
+ * interrupted) are discarded.
+ *
+ * @param[in] archive_path Path of frame archive
+ */
+FrameArchiveWriter::FrameArchiveWriter(const string& archive_path) {
+    this->_archive_path = archive_path;
+    string index_path = getFrameIndexPath(archive_path);
+    if (!fs::exists(archive_path)) {
+        FrameArchiveHeader archive_header = _makeHeader(FRAME_ARCHIVE_MAGIC);
+        FrameArchiveHeader index_header = _makeHeader(FRAME_INDEX_MAGIC);
+        ofstream archive(archive_path, ios::out | ios::binary | ios::trunc);
+        archive.write(reinterpret_cast<const char*>(&archive_header), sizeof(archive_header));
+        ofstream index(index_path, ios::out | ios::binary | ios::trunc);
+        index.write(reinterpret_cast<const char*>(&index_header), sizeof(index_header));
+        if (!archive || !index)
+            throw runtime_error("can't create frame archive " + archive_path);
+    }
+
+    uint64_t archive_size = sizeof(FrameArchiveHeader);
+    {
+        ifstream archive(archive_path, ios::in | ios::binary);
+        _readHeader(archive, FRAME_ARCHIVE_MAGIC, archive_path);
+        ifstream index(index_path, ios::in | ios::binary);
+        _readHeader(index, FRAME_INDEX_MAGIC, index_path);
+        uint64_t num_entries = (fs::file_size(index_path) - sizeof(FrameArchiveHeader)) / sizeof(FrameIndexEntry);
+        if (num_entries > 0) {
+            FrameIndexEntry last;
+            index.seekg(sizeof(FrameArchiveHeader) + (num_entries - 1) * sizeof(FrameIndexEntry));
+            index.read(reinterpret_cast<char*>(&last), sizeof(last));
+            archive_size = last.offset + last.size;
+        }
+        fs::resize_file(index_path, sizeof(FrameArchiveHeader) + num_entries * sizeof(FrameIndexEntry));
+        fs::resize_file(archive_path, archive_size);
+    }
+    this->_archive_size = archive_size;
+    this->_archive.open(archive_path, ios::out | ios::binary | ios::app);
+    this->_index.open(index_path, ios::out | ios::binary | ios::app);
+    if (!this->_archive || !this->_index)
+        throw runtime_error("can't open frame archive " + archive_path);
+}
+
+
+/** @brief Append a frame
+ *
+ * @param[in] time Time slice of the frame
+ * @param[in] frame Frame data (a TGA file)
+ * @param[in] size Bytes of frame data
+ */
+void FrameArchiveWriter::append(int time, const char* frame, size_t size) {
+    this->_archive.write(frame, size);
+    this->_archive.flush();
+    if (!this->_archive)
+        throw runtime_error("can't write frame archive " + this->_archive_path);
+    FrameIndexEntry entry;
+    entry.time = time;
+    entry.offset = this->_archive_size;
+    entry.size = size;
+    this->_index.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    this->_index.flush();
+    if (!this->_index)
+        throw runtime_error("can't write index of frame archive " + this->_archive_path);
+    this->_archive_size += size;
+}
+
+
+/*********************************************************
+ * FrameArchiveReader implementation
+ ********************************************************/
+
+/** @brief Initializer: read the index of a frame archive
+ *
+ * @param[in] archive_path Path of frame archive
+ */
+FrameArchiveReader::FrameArchiveReader(const string& archive_path) {
+    this->_archive_path = archive_path;
+    string index_path = getFrameIndexPath(archive_path);
+    ifstream index(index_path, ios::in | ios::binary);
+    _readHeader(index, FRAME_INDEX_MAGIC, index_path);
+    uint64_t num_entries = (fs::file_size(index_path) - sizeof(FrameArchiveHeader)) / sizeof(FrameIndexEntry);
+    vector<FrameIndexEntry> entries(num_entries);
+    index.read(reinterpret_cast<char*>(entries.data()), num_entries * sizeof(FrameIndexEntry));
+    for (const FrameIndexEntry& entry : entries)
+        this->_entries[(int)entry.time] = entry;
+    this->_archive.open(archive_path, ios::in | ios::binary);
+    _readHeader(this->_archive, FRAME_ARCHIVE_MAGIC, archive_path);
+}
+
+
+/** @brief Get the time slices having a frame, in increasing order
+ */
+vector<int> FrameArchiveReader::times() const {
+    vector<int> times;
+    for (auto& it : this->_entries)
+        times.push_back(it.first);
+    return times;
+}
+
+
+/** @brief Read the frame of a time slice
+ *
+ * @param[in] time Time slice
+ * @param[out] frame Frame data (a TGA file)
+ *
+ * @returns False if there is no frame for time
+ */
+bool FrameArchiveReader::read(int time, vector<char>& frame) {
+    auto it = this->_entries.find(time);
+    if (it == this->_entries.end())
+        return false;
+    frame.resize(it->second.size);
+    this->_archive.clear();
+    this->_archive.seekg(it->second.offset);
+    this->_archive.read(frame.data(), frame.size());
+    if (!this->_archive)
+        throw runtime_error("can't read frame " + to_string(time) + " of " + this->_archive_path);
+    return true;
+}
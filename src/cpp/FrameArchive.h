@@ -0,0 +1,89 @@
+/** @file FrameArchive.h
+ * @brief Header of frame archives
+ *
+ * @ingroup core
+ */
+
+#ifndef FRAMEARCHIVE_H_INCLUDED
+#define FRAMEARCHIVE_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+using namespace std;
+
+
+/** @brief Fixed-size header at the beginning of a frame archive and of its index
+ *
+ * A frame archive is a single file where frames (complete RLE-compressed
+ * TGA images) are appended one after the other. Its index is a sidecar
+ * file with the same header and one FrameIndexEntry per frame, so the
+ * location of any frame is read without walking the archive. A frame is
+ * added to the index only after it is completely written to the archive.
+ *
+ * @ingroup core
+ */
+struct FrameArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+};
+
+/** @brief Location of a frame in a frame archive
+ */
+struct FrameIndexEntry {
+    int64_t time;
+    uint64_t offset;
+    uint64_t size;
+};
+
+const char FRAME_ARCHIVE_MAGIC[8] = {'E', 'C', 'O', 'F', 'R', 'A', 'M', 'E'};
+const char FRAME_INDEX_MAGIC[8] = {'E', 'C', 'O', 'F', 'R', 'I', 'D', 'X'};
+const uint32_t FRAME_ARCHIVE_VERSION = 1;
+
+
+/** @brief Appends frames to a frame archive (created if it doesn't exist)
+ *
+ * Both files are kept open between frames. An index entry left incomplete
+ * by an interrupted write is dropped when the archive is opened again.
+ *
+ * @ingroup core
+ */
+class FrameArchiveWriter {
+public:
+    FrameArchiveWriter(const string& archive_path);
+    void append(int time, const char* frame, size_t size);
+private:
+    string _archive_path;
+    ofstream _archive;
+    ofstream _index;
+    uint64_t _archive_size;
+};
+
+
+/** @brief Random access to the frames of a frame archive
+ *
+ * If a time was saved several times (experiment resumed from an earlier
+ * time) its last frame is the one read.
+ *
+ * @ingroup core
+ */
+class FrameArchiveReader {
+public:
+    FrameArchiveReader(const string& archive_path);
+    vector<int> times() const;
+    bool read(int time, vector<char>& frame);
+private:
+    string _archive_path;
+    ifstream _archive;
+    map<int, FrameIndexEntry> _entries;
+};
+
+string getFrameIndexPath(const string& archive_path);
+
+
+#endif  // FRAMEARCHIVE_H_INCLUDED
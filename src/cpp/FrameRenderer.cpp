@@ -0,0 +1,204 @@
+/** @file FrameRenderer.cpp
+ * @brief Frame rendering definition
+ *
+ * @ingroup core
+ */
+
+#include "FrameRenderer.h"
+#include <cstring>
+#include <algorithm>
+
+
+/*********************************************************
+ * ColourPalette implementation
+ ********************************************************/
+
+/** @brief Initializer: precompute the colours of every species, energy and age level
+ *
+ * @param[in] species_colours Base colour of each species, indexed by SpeciesId
+ */
+ColourPalette::ColourPalette(const vector<SpeciesColour>& species_colours) {
+    size_t levels_per_species = PALETTE_ENERGY_LEVELS * PALETTE_AGE_LEVELS;
+    this->_bgr.assign(3 * (1 + species_colours.size() * levels_per_species), 0);
+    uint8_t* entry = &this->_bgr[3];  // entry 0 is EMPTY_CELL_PALETTE_INDEX
+    for (const SpeciesColour& c : species_colours) {
+        for (int e = 0; e < PALETTE_ENERGY_LEVELS; e++) {
+            float energy_ratio = 2.0f * (e + 0.5f) / PALETTE_ENERGY_LEVELS;
+            for (int a = 0; a < PALETTE_AGE_LEVELS; a++) {
+                float life_ratio = (a + 0.5f) / PALETTE_AGE_LEVELS;
+                float k = 0.5f * energy_ratio * life_ratio;  // in [0, 1]
+                entry[0] = (uint8_t)(c.b * k * 255);
+                entry[1] = (uint8_t)(c.g * k * 255);
+                entry[2] = (uint8_t)(c.r * k * 255);
+                entry += 3;
+            }
+        }
+    }
+}
+
+
+/** @brief Get the palette index of an organism
+ *
+ * Organisms without initial energy reserve or death age are drawn as
+ * having full energy or life.
+ *
+ * @param[in] organisms Store where organism lives
+ * @param[in] i Index of organism in store
+ */
+PaletteIndex ColourPalette::index(const OrganismStore& organisms, uint32_t i) const {
+    float initial_energy_reserve = organisms.initial_energy_reserve[i];
+    float energy_ratio = (initial_energy_reserve > 0) ? organisms.energy_reserve[i] / initial_energy_reserve : 1.0f;
+    if (!(energy_ratio > 0.0f))
+        energy_ratio = 0.0f;  // also NaN
+    int energy_level = min(PALETTE_ENERGY_LEVELS - 1, (int)(min(energy_ratio, 2.0f) * (PALETTE_ENERGY_LEVELS / 2)));
+    int death_age = organisms.death_age[i];
+    float life_ratio = (death_age > 0) ? 1.0f - (float)organisms.age[i] / death_age : 1.0f;
+    if (!(life_ratio > 0.0f))
+        life_ratio = 0.0f;
+    int age_level = min(PALETTE_AGE_LEVELS - 1, (int)(min(life_ratio, 1.0f) * PALETTE_AGE_LEVELS));
+    return 1 + ((PaletteIndex)organisms.species[i] * PALETTE_ENERGY_LEVELS + energy_level) * PALETTE_AGE_LEVELS + age_level;
+}
+
+
+/*********************************************************
+ * Capture and rendering
+ ********************************************************/
+
+/** @brief Capture the palette index of every cell of the biotope
+ *
+ * Only the picture is captured: zoom_factor and drawing settings are set
+ * by the caller.
+ *
+ * @param[in] ecosystem Ecosystem to capture
+ * @param[in] palette Colours of organisms
+ * @param[out] capture Frame capture (its cells are reused)
+ */
+void captureFrame(const Ecosystem& ecosystem, shared_ptr<const ColourPalette> palette, FrameCapture& capture) {
+    capture.time = ecosystem.time;
+    capture.size_x = ecosystem.biotope_size_x;
+    capture.size_y = ecosystem.biotope_size_y;
+    capture.palette = palette;
+    capture.full = true;
+    capture.dirty_cells.clear();
+    int num_cells = ecosystem.biotope.numCells();
+    capture.cells.resize(num_cells);
+    for (int cell = 0; cell < num_cells; cell++) {
+        OrganismHandle o = ecosystem.biotope.get(cell);
+        capture.cells[cell] = o.isNull() ? EMPTY_CELL_PALETTE_INDEX : palette->index(ecosystem.organisms, o.index);
+    }
+}
+
+
+/** @brief Capture the biotope as changes to the previous capture
+ *
+ * A cell is dirty when its palette index differs from the one in
+ * drawn_cells (the cells of the previous capture). Cells where organisms
+ * were born, died or moved are taken from ecosystem.biotope_changes (which
+ * is drained); every occupied cell is checked too, since the colour of an
+ * organism fades as it starves or ages, but as colours are quantized most
+ * of them keep their palette index between frames.
+ *
+ * So rendering cost scales with the number of dirty cells, but this
+ * capture still walks the whole grid (in the simulation thread) every
+ * frame: only empty cells are skipped without looking up a colour.
+ *
+ * drawn_cells is updated and copied into capture.cells, so the capture
+ * can also be rendered in full (e.g. if the previous one was dropped).
+ *
+ * @param[in,out] ecosystem Ecosystem to capture
+ * @param[in] palette Colours of organisms (the one drawn_cells was captured with)
+ * @param[in,out] drawn_cells Palette index of each cell in previous capture
+ * @param[out] capture Frame capture (its cells are reused)
+ */
+void captureChangedCells(Ecosystem& ecosystem, shared_ptr<const ColourPalette> palette,
+                         vector<PaletteIndex>& drawn_cells, FrameCapture& capture) {
+    capture.time = ecosystem.time;
+    capture.size_x = ecosystem.biotope_size_x;
+    capture.size_y = ecosystem.biotope_size_y;
+    capture.palette = palette;
+    capture.full = false;
+    capture.dirty_cells.clear();
+    vector<int>& dirty_cells = capture.dirty_cells;
+    ecosystem.biotope_changes.drain(dirty_cells);
+    for (int cell : dirty_cells) {
+        OrganismHandle o = ecosystem.biotope.get(cell);
+        drawn_cells[cell] = o.isNull() ? EMPTY_CELL_PALETTE_INDEX : palette->index(ecosystem.organisms, o.index);
+    }
+    size_t num_moved = dirty_cells.size();
+    int num_cells = ecosystem.biotope.numCells();
+    for (int cell = 0; cell < num_cells; cell++) {
+        OrganismHandle o = ecosystem.biotope.get(cell);
+        if (o.isNull())
+            continue;
+        PaletteIndex index = palette->index(ecosystem.organisms, o.index);
+        if (drawn_cells[cell] != index) {
+            drawn_cells[cell] = index;
+            dirty_cells.push_back(cell);
+        }
+    }
+    // both runs are sorted and disjoint (moved cells were already updated in drawn_cells)
+    if (num_moved < dirty_cells.size())
+        inplace_merge(dirty_cells.begin(), dirty_cells.begin() + num_moved, dirty_cells.end());
+    capture.cells = drawn_cells;
+}
+
+
+/** @brief Draw a frame capture into a BGR frame
+ *
+ * Each row of cells is written once into the frame (every cell as a span
+ * of zoom_factor pixels) and then copied zoom_factor - 1 times below it.
+ *
+ * @param[in] capture Frame capture
+ * @param[out] bgr_frame (size_x * zoom_factor) x (size_y * zoom_factor) pixels
+ *                       of 3 bytes, top row first
+ */
+void renderFrame(const FrameCapture& capture, uint8_t* bgr_frame) {
+    int zoom_factor = capture.zoom_factor;
+    size_t row_bytes = (size_t)capture.size_x * zoom_factor * 3;
+    const ColourPalette& palette = *capture.palette;
+    const PaletteIndex* cell = capture.cells.data();
+    for (int y = 0; y < capture.size_y; y++) {
+        uint8_t* row = bgr_frame + (size_t)y * zoom_factor * row_bytes;
+        uint8_t* pixel = row;
+        for (int x = 0; x < capture.size_x; x++, cell++) {
+            const uint8_t* colour = palette.bgr(*cell);
+            for (int fx = 0; fx < zoom_factor; fx++) {
+                pixel[0] = colour[0];
+                pixel[1] = colour[1];
+                pixel[2] = colour[2];
+                pixel += 3;
+            }
+        }
+        for (int fy = 1; fy < zoom_factor; fy++)
+            memcpy(row + fy * row_bytes, row, row_bytes);
+    }
+}
+
+
+/** @brief Draw the dirty cells of a frame capture over the previous frame
+ *
+ * bgr_frame must hold the rendering of the previous capture; only the
+ * zoom_factor x zoom_factor blocks of capture.dirty_cells are repainted.
+ *
+ * @param[in] capture Frame capture (not full)
+ * @param[in,out] bgr_frame Frame as in renderFrame()
+ */
+void renderCells(const FrameCapture& capture, uint8_t* bgr_frame) {
+    int zoom_factor = capture.zoom_factor;
+    size_t row_bytes = (size_t)capture.size_x * zoom_factor * 3;
+    size_t span_bytes = (size_t)zoom_factor * 3;
+    const ColourPalette& palette = *capture.palette;
+    for (int cell : capture.dirty_cells) {
+        int x = cell % capture.size_x;
+        int y = cell / capture.size_x;
+        const uint8_t* colour = palette.bgr(capture.cells[cell]);
+        uint8_t* span = bgr_frame + (size_t)y * zoom_factor * row_bytes + (size_t)x * span_bytes;
+        for (int fx = 0; fx < zoom_factor; fx++) {
+            span[3 * fx] = colour[0];
+            span[3 * fx + 1] = colour[1];
+            span[3 * fx + 2] = colour[2];
+        }
+        for (int fy = 1; fy < zoom_factor; fy++)
+            memcpy(span + fy * row_bytes, span, span_bytes);
+    }
+}
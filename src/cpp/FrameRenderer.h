@@ -0,0 +1,100 @@
+/** @file FrameRenderer.h
+ * @brief Header of frame rendering
+ *
+ * @ingroup core
+ */
+
+#ifndef FRAMERENDERER_H_INCLUDED
+#define FRAMERENDERER_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+#include "ecosystem.h"
+
+using namespace std;
+
+
+/** @brief Base RGB colour of a species (components in [0, 1])
+ */
+struct SpeciesColour {
+    float r;
+    float g;
+    float b;
+};
+
+/** @brief Position of a colour in a ColourPalette
+ */
+typedef uint32_t PaletteIndex;
+
+/** @brief Palette index of cells without organism (black)
+ */
+const PaletteIndex EMPTY_CELL_PALETTE_INDEX = 0;
+
+/** @brief Levels of energy ratio (energy reserve / initial energy reserve, in [0, 2])
+ */
+const int PALETTE_ENERGY_LEVELS = 32;
+
+/** @brief Levels of remaining life (1 - age / death age, in [0, 1])
+ */
+const int PALETTE_AGE_LEVELS = 32;
+
+
+/** @brief Lookup table of organism colours by species, energy and age
+ *
+ * The colour of an organism is the colour of its species scaled by
+ * 0.5 * energy_ratio * life_ratio, so it fades as the organism starves
+ * or ages. Both ratios are clamped (energy_ratio to [0, 2], life_ratio to
+ * [0, 1]) and quantized, and every combination is precomputed, so drawing
+ * an organism costs a table lookup. Colours are stored as 3 bytes (blue,
+ * green, red), the pixel layout of TGAImage.
+ *
+ * @ingroup core
+ */
+class ColourPalette {
+public:
+    ColourPalette(const vector<SpeciesColour>& species_colours);
+    PaletteIndex index(const OrganismStore& organisms, uint32_t i) const;
+    const uint8_t* bgr(PaletteIndex index) const { return &this->_bgr[3 * index]; }
+    size_t size() const { return this->_bgr.size() / 3; }
+private:
+    vector<uint8_t> _bgr;
+};
+
+
+/** @brief Immutable picture of the biotope at a time, to be rendered later (maybe in another thread)
+ */
+struct FrameCapture {
+    int time;
+    int size_x;
+    int size_y;
+    /** @brief Palette index of each cell, in row-major order
+    */
+    vector<PaletteIndex> cells;
+    shared_ptr<const ColourPalette> palette;
+    /** @brief If false, only dirty_cells changed since the previous capture
+    * (see captureChangedCells())
+    */
+    bool full;
+    /** @brief Cells whose palette index changed since the previous capture, in increasing order
+    */
+    vector<int> dirty_cells;
+    /** @brief How the frame is drawn: DRAWING_ZOOM_FACTOR, DRAWING_FORMAT,
+    * DRAWING_STREAM and DRAWING_ENCODER_THREADS of the ecosystem (see CompiledSettings)
+    */
+    int zoom_factor;
+    int drawing_format;
+    string drawing_stream_path;
+    int drawing_stream_fps;
+    int drawing_encoder_threads;
+};
+
+void captureFrame(const Ecosystem& ecosystem, shared_ptr<const ColourPalette> palette, FrameCapture& capture);
+void captureChangedCells(Ecosystem& ecosystem, shared_ptr<const ColourPalette> palette,
+                         vector<PaletteIndex>& drawn_cells, FrameCapture& capture);
+void renderFrame(const FrameCapture& capture, uint8_t* bgr_frame);
+void renderCells(const FrameCapture& capture, uint8_t* bgr_frame);
+
+
+#endif  // FRAMERENDERER_H_INCLUDED
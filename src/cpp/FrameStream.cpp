@@ -0,0 +1,244 @@
+/** @file FrameStream.cpp
+ * @brief FrameStream definition
+ *
+ * @ingroup core
+ */
+
+#include "FrameStream.h"
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <stdexcept>
+
+
+/** @brief Initializer: start writer thread
+ *
+ * @param[in] path Path of named pipe or file, or "-" for stdout
+ * @param[in] format Video format
+ * @param[in] width Frame width in pixels
+ * @param[in] height Frame height in pixels
+ * @param[in] fps Frame rate written in Y4M header
+ * @param[in] queue_capacity Maximum number of frames waiting to be written
+ */
+FrameStream::FrameStream(const string& path, FrameStreamFormat format, int width, int height,
+                         int fps, size_t queue_capacity) : _queue(queue_capacity) {
+    this->_path = path;
+    this->_format = format;
+    this->_width = width;
+    this->_height = height;
+    this->_fps = fps;
+    this->_fd = -1;
+    this->_stopping = false;
+    this->_waiting_for_reader = false;
+    this->_stats = FrameStreamStats();
+    this->_worker = thread(&FrameStream::_workerLoop, this);
+}
+
+
+/** @brief Destructor: write queued frames and stop writer thread
+ *
+ * Queued frames are still written once the queue is closed; stopping only
+ * ends the wait for the reader of a named pipe, whose frames are dropped.
+ */
+FrameStream::~FrameStream() {
+    this->_queue.close();
+    this->_stopping = true;
+    this->_worker.join();
+    if (this->_fd >= 0)
+        close(this->_fd);
+}
+
+
+/** @brief Get a (recycled if possible) frame buffer to be filled and pushed
+ */
+vector<uint8_t> FrameStream::acquire() {
+    lock_guard<mutex> lock(this->_mtx);
+    if (this->_recycled.empty())
+        return vector<uint8_t>();
+    vector<uint8_t> bgr_frame = move(this->_recycled.back());
+    this->_recycled.pop_back();
+    return bgr_frame;
+}
+
+
+/** @brief Queue a frame to be streamed, or drop it if the queue is full
+ *
+ * The size of the stream is fixed when it is created, so a frame of
+ * another size (e.g. after DRAWING_ZOOM_FACTOR changed) is rejected.
+ *
+ * @param[in] bgr_frame width * height pixels, 3 bytes (blue, green, red) each, top row first
+ */
+void FrameStream::push(vector<uint8_t>&& bgr_frame) {
+    if (bgr_frame.size() != (size_t)3 * this->_width * this->_height)
+        throw invalid_argument("frame of " + to_string(bgr_frame.size()) + " bytes in a "
+                               + to_string(this->_width) + "x" + to_string(this->_height) + " stream");
+    {
+        lock_guard<mutex> lock(this->_mtx);
+        this->_stats.pending++;
+    }
+    if (!this->_queue.tryPush(move(bgr_frame))) {
+        lock_guard<mutex> lock(this->_mtx);
+        this->_stats.dropped++;
+        this->_stats.pending--;
+        this->_recycled.push_back(move(bgr_frame));
+    }
+}
+
+
+/** @brief Wait until all pushed frames are written (or dropped)
+ *
+ * Doesn't wait while the named pipe has no reader: frames stay queued.
+ */
+void FrameStream::flush() {
+    unique_lock<mutex> lock(this->_mtx);
+    this->_cv_flushed.wait(lock, [this] { return (this->_stats.pending == 0) || this->_waiting_for_reader; });
+}
+
+
+/** @brief Get stream counters
+ */
+FrameStreamStats FrameStream::stats() {
+    lock_guard<mutex> lock(this->_mtx);
+    return this->_stats;
+}
+
+
+/** @brief Loop of writer thread: open the output and write frames until the queue is closed
+ */
+void FrameStream::_workerLoop() {
+    bool ok = this->_open();
+    vector<uint8_t> bgr_frame;
+    vector<uint8_t> out;
+    while (this->_queue.pop(bgr_frame)) {
+        if (ok) {
+            this->_convert(bgr_frame, out);
+            ok = this->_writeAll(out.data(), out.size());
+            if (!ok)
+                cerr << "frame stream " << this->_path << " closed: " << strerror(errno) << endl;
+        }
+        {
+            lock_guard<mutex> lock(this->_mtx);
+            if (ok)
+                this->_stats.written++;
+            else
+                this->_stats.dropped++;
+            this->_stats.pending--;
+            this->_recycled.push_back(move(bgr_frame));
+        }
+        this->_cv_flushed.notify_all();
+    }
+}
+
+
+/** @brief Open the output and write the stream header
+ *
+ * For a named pipe, wait (polling, so the stream can be stopped) until
+ * a consumer opens it for reading.
+ *
+ * @returns false if the output can't be opened
+ */
+bool FrameStream::_open() {
+    if (this->_path == "-") {
+        this->_fd = dup(STDOUT_FILENO);
+    } else {
+        struct stat path_stat;
+        if ((stat(this->_path.c_str(), &path_stat) == 0) && S_ISFIFO(path_stat.st_mode)) {
+            while (!this->_stopping) {
+                this->_fd = open(this->_path.c_str(), O_WRONLY | O_NONBLOCK);
+                if ((this->_fd >= 0) || (errno != ENXIO))
+                    break;
+                this->_setWaitingForReader(true);
+                this_thread::sleep_for(chrono::milliseconds(100));  // no reader yet
+            }
+            this->_setWaitingForReader(false);
+            if (this->_fd >= 0)
+                fcntl(this->_fd, F_SETFL, fcntl(this->_fd, F_GETFL) & ~O_NONBLOCK);
+        } else {
+            this->_fd = open(this->_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+    }
+    if (this->_fd < 0) {
+        if (!this->_stopping)
+            cerr << "can't open frame stream " << this->_path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if (this->_format == FRAME_STREAM_Y4M) {
+        string header = "YUV4MPEG2 W" + to_string(this->_width) + " H" + to_string(this->_height) +
+                        " F" + to_string(this->_fps) + ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+        return this->_writeAll(reinterpret_cast<const uint8_t*>(header.data()), header.size());
+    }
+    return true;
+}
+
+
+/** @brief Record whether the writer thread waits for the reader of a named pipe, waking flush()
+ */
+void FrameStream::_setWaitingForReader(bool waiting) {
+    {
+        lock_guard<mutex> lock(this->_mtx);
+        this->_waiting_for_reader = waiting;
+    }
+    this->_cv_flushed.notify_all();
+}
+
+
+/** @brief Write a buffer to the output, retrying partial writes
+ *
+ * @returns false if the output is closed (e.g. the consumer exited)
+ */
+bool FrameStream::_writeAll(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(this->_fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+
+/** @brief Convert a BGR frame to the output format
+ *
+ * Y4M frames are converted to full range YCbCr (BT.601) in planar 4:4:4,
+ * so no pixel is averaged with its neighbours.
+ *
+ * @param[in] bgr_frame Frame as given to push()
+ * @param[out] out Bytes to be written for the frame
+ */
+void FrameStream::_convert(const vector<uint8_t>& bgr_frame, vector<uint8_t>& out) {
+    size_t num_pixels = (size_t)this->_width * this->_height;
+    if (this->_format == FRAME_STREAM_RGB) {
+        out.resize(3 * num_pixels);
+        for (size_t i = 0; i < num_pixels; i++) {
+            out[3 * i] = bgr_frame[3 * i + 2];
+            out[3 * i + 1] = bgr_frame[3 * i + 1];
+            out[3 * i + 2] = bgr_frame[3 * i];
+        }
+        return;
+    }
+    const char frame_tag[] = "FRAME\n";
+    size_t tag_size = sizeof(frame_tag) - 1;
+    out.resize(tag_size + 3 * num_pixels);
+    memcpy(out.data(), frame_tag, tag_size);
+    uint8_t* y_plane = out.data() + tag_size;
+    uint8_t* u_plane = y_plane + num_pixels;
+    uint8_t* v_plane = u_plane + num_pixels;
+    for (size_t i = 0; i < num_pixels; i++) {
+        int b = bgr_frame[3 * i];
+        int g = bgr_frame[3 * i + 1];
+        int r = bgr_frame[3 * i + 2];
+        // coefficients scaled by 256, offset 128 of chroma added before shifting
+        y_plane[i] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+        u_plane[i] = (uint8_t)min(255, (-43 * r - 85 * g + 128 * b + 32896) >> 8);
+        v_plane[i] = (uint8_t)min(255, (128 * r - 107 * g - 21 * b + 32896) >> 8);
+    }
+}
@@ -0,0 +1,94 @@
+/** @file FrameStream.h
+ * @brief Header of FrameStream
+ *
+ * @ingroup core
+ */
+
+#ifndef FRAMESTREAM_H_INCLUDED
+#define FRAMESTREAM_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "BoundedQueue.h"
+
+using namespace std;
+
+
+/** @brief Video format of a FrameStream
+ */
+enum FrameStreamFormat {
+    FRAME_STREAM_Y4M = 0,  // YUV4MPEG2, 4:4:4 full range (e.g. "ffmpeg -i pipe")
+    FRAME_STREAM_RGB = 1   // raw rgb24 frames, no header (e.g. "ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i pipe")
+};
+
+/** @brief Counters of a FrameStream
+ */
+struct FrameStreamStats {
+    uint64_t written;
+    /** @brief Frames discarded because the queue was full or the consumer went away
+    */
+    uint64_t dropped;
+    /** @brief Frames queued and not yet written nor dropped
+    */
+    uint64_t pending;
+};
+
+
+/** @brief Background thread streaming drawn frames as video to a pipe, a file or stdout
+ *
+ * The simulation thread hands over BGR frames (as drawn in a TGAImage)
+ * with push(), which never waits: if the consumer (e.g. an encoder
+ * reading a named pipe) is slower than the simulation and the queue is
+ * full, the frame is dropped. Conversion to the output format is done by
+ * the writer thread.
+ *
+ * Frame buffers are recycled: get one with acquire() to avoid an
+ * allocation per frame.
+ *
+ * A named pipe is opened by the writer thread once there is a reader, so
+ * the simulation goes on (dropping frames) until the consumer starts. If
+ * the consumer closes the pipe the stream stops and every later frame is
+ * dropped.
+ *
+ * flush() and the destructor write every queued frame before returning,
+ * unless the output of a named pipe is not open yet (no consumer).
+ *
+ * @ingroup core
+ */
+class FrameStream {
+public:
+    FrameStream(const string& path, FrameStreamFormat format, int width, int height, int fps, size_t queue_capacity);
+    ~FrameStream();
+    vector<uint8_t> acquire();
+    void push(vector<uint8_t>&& bgr_frame);
+    void flush();
+    FrameStreamStats stats();
+private:
+    string _path;
+    FrameStreamFormat _format;
+    int _width;
+    int _height;
+    int _fps;
+    int _fd;
+    atomic<bool> _stopping;
+    bool _waiting_for_reader;
+    BoundedQueue<vector<uint8_t>> _queue;
+    vector<vector<uint8_t>> _recycled;
+    mutex _mtx;
+    condition_variable _cv_flushed;
+    FrameStreamStats _stats;
+    thread _worker;
+    void _workerLoop();
+    bool _open();
+    void _setWaitingForReader(bool waiting);
+    bool _writeAll(const uint8_t* data, size_t size);
+    void _convert(const vector<uint8_t>& bgr_frame, vector<uint8_t>& out);
+};
+
+
+#endif  // FRAMESTREAM_H_INCLUDED
@@ -0,0 +1,92 @@
+/** @file RandomStream.cpp
+ * @brief RandomStream definition
+ *
+ * @ingroup core
+ */
+
+#include "RandomStream.h"
+
+
+/** @brief Philox4x32-10 block function (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+ *
+ * @param[in] counter 128-bit counter
+ * @param[in] key 64-bit key
+ * @param[out] output 128 random bits
+ */
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4]) {
+    const uint32_t M0 = 0xD2511F53;
+    const uint32_t M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9;
+    const uint32_t W1 = 0xBB67AE85;
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)M0 * c0;
+        uint64_t p1 = (uint64_t)M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n1 = (uint32_t)p1;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        uint32_t n3 = (uint32_t)p0;
+        c0 = n0; c1 = n1; c2 = n2; c3 = n3;
+        k0 += W0;
+        k1 += W1;
+    }
+    output[0] = c0;
+    output[1] = c1;
+    output[2] = c2;
+    output[3] = c3;
+}
+
+
+/** @brief Initializer
+ *
+ * @param[in] seed Seed of the experiment
+ * @param[in] tick Ecosystem time
+ * @param[in] stream_id Identifier of the stream within its domain
+ * @param[in] domain Kind of stream
+ */
+RandomStream::RandomStream(uint32_t seed, uint32_t tick, uint32_t stream_id, RandomDomain domain) : _num_used(4) {
+    _key[0] = seed;
+    _key[1] = 0;
+    _counter[0] = tick;
+    _counter[1] = stream_id;
+    _counter[2] = (uint32_t)domain;
+    _counter[3] = 0;
+}
+
+
+/** @brief Get next 32 random bits of the stream
+ */
+RandomStream::result_type RandomStream::operator()() {
+    if (_num_used == 4) {
+        philox4x32(_counter, _key, _block);
+        _counter[3] += 1;
+        _num_used = 0;
+    }
+    return _block[_num_used++];
+}
+
+
+/** @brief Get a random integer uniformly distributed in [min_value, max_value]
+ *
+ * Unbiased multiply-and-reject method (Lemire).
+ */
+int RandomStream::uniformInt(int min_value, int max_value) {
+    uint32_t range = (uint32_t)max_value - (uint32_t)min_value + 1;
+    if (range == 0)  // full 32-bit range
+        return (int)(*this)();
+    uint64_t m = (uint64_t)(*this)() * range;
+    if ((uint32_t)m < range) {
+        uint32_t threshold = (0 - range) % range;
+        while ((uint32_t)m < threshold)
+            m = (uint64_t)(*this)() * range;
+    }
+    return (int)((uint32_t)min_value + (uint32_t)(m >> 32));
+}
+
+
+/** @brief Get a random float uniformly distributed in [0, 1)
+ */
+float RandomStream::uniform01() {
+    return ((*this)() >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,59 @@
+/** @file RandomStream.h
+ * @brief Header of RandomStream
+ *
+ * @ingroup core
+ */
+
+#ifndef RANDOMSTREAM_H_INCLUDED
+#define RANDOMSTREAM_H_INCLUDED
+
+#include <cstdint>
+
+using namespace std;
+
+
+/** @brief Kinds of random streams, so streams with equal ids never overlap
+ */
+enum RandomDomain {
+    RANDOM_DOMAIN_ORGANISM = 0,       // stream id: cell where the organism starts acting
+    RANDOM_DOMAIN_INITIALIZATION = 1  // stream id: 0
+};
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4]);
+
+
+/** @brief Counter-based random stream (Philox4x32-10)
+ *
+ * The n-th value of a stream is a pure function of (seed, tick, stream id,
+ * domain, n): streams don't share any state, so draws don't depend on the
+ * order in which organisms act, and the state of the whole simulation is
+ * just its seed and its time.
+ *
+ * It can be used as a UniformRandomBitGenerator, but uniformInt() and
+ * uniform01() should be preferred: their results don't depend on the
+ * standard library implementation.
+ *
+ * @ingroup core
+ */
+class RandomStream {
+public:
+    typedef uint32_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFF; }
+
+    RandomStream() : RandomStream(0, 0, 0, RANDOM_DOMAIN_INITIALIZATION) {}
+    RandomStream(uint32_t seed, uint32_t tick, uint32_t stream_id, RandomDomain domain);
+    result_type operator()();
+    int uniformInt(int min_value, int max_value);
+    float uniform01();
+private:
+    uint32_t _key[2];
+    /** @brief (tick, stream id, domain, block): one block gives 4 values
+     */
+    uint32_t _counter[4];
+    uint32_t _block[4];
+    int _num_used;
+};
+
+
+#endif  // RANDOMSTREAM_H_INCLUDED
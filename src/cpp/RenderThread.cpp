@@ -0,0 +1,149 @@
+/** @file RenderThread.cpp
+ * @brief RenderThread definition
+ *
+ * @ingroup core
+ */
+
+#include "RenderThread.h"
+#include <chrono>
+#include <iostream>
+
+
+/** @brief Initializer: start render thread
+ *
+ * @param[in] queue_capacity Maximum number of captures waiting to be rendered
+ * @param[in] policy What submit() does when the queue is full
+ * @param[in] output Function called (from render thread) with every rendered image
+ */
+RenderThread::RenderThread(size_t queue_capacity, RenderQueuePolicy policy,
+                           function<void(const FrameCapture&, TGAImage&)> output) : _queue(queue_capacity) {
+    this->_policy = policy;
+    this->_output = output;
+    this->_stats = RenderThreadStats();
+    this->_frame_valid = false;
+    this->_force_full = false;
+    this->_worker = thread(&RenderThread::_workerLoop, this);
+}
+
+
+/** @brief Destructor: render all pending captures and stop render thread
+ */
+RenderThread::~RenderThread() {
+    this->_queue.close();
+    this->_worker.join();
+}
+
+
+/** @brief Get an (empty or recycled) capture to be filled and submitted
+ */
+unique_ptr<FrameCapture> RenderThread::acquire() {
+    lock_guard<mutex> lock(this->_mtx);
+    if (this->_recycled.empty())
+        return unique_ptr<FrameCapture>(new FrameCapture());
+    unique_ptr<FrameCapture> capture = move(this->_recycled.back());
+    this->_recycled.pop_back();
+    return capture;
+}
+
+
+/** @brief Queue a capture to be rendered; if the queue is full, wait or drop it
+ *
+ * @param[in] capture Capture got from acquire() and filled
+ */
+void RenderThread::submit(unique_ptr<FrameCapture> capture) {
+    {
+        lock_guard<mutex> lock(this->_mtx);
+        this->_stats.submitted++;
+        this->_stats.pending++;
+        this->_stats.max_pending = max(this->_stats.max_pending, this->_stats.pending);
+    }
+    if (this->_policy == RENDER_QUEUE_DROP) {
+        if (this->_force_full)
+            capture->full = true;
+        if (!this->_queue.tryPush(move(capture))) {
+            {
+                lock_guard<mutex> lock(this->_mtx);
+                this->_stats.dropped++;
+                this->_stats.pending--;
+            }
+            this->_force_full = true;
+            this->_recycle(move(capture));
+            this->_cv_flushed.notify_all();
+        } else {
+            this->_force_full = false;
+        }
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    bool waited = false;
+    this->_queue.push(move(capture), &waited);
+    if (waited) {
+        auto end = chrono::steady_clock::now();
+        lock_guard<mutex> lock(this->_mtx);
+        this->_stats.stalls++;
+        this->_stats.stall_ms += chrono::duration<double, milli>(end - start).count();
+    }
+}
+
+
+/** @brief Wait until all submitted captures are rendered (or dropped)
+ */
+void RenderThread::flush() {
+    unique_lock<mutex> lock(this->_mtx);
+    this->_cv_flushed.wait(lock, [this] { return this->_stats.pending == 0; });
+}
+
+
+/** @brief Get render counters
+ */
+RenderThreadStats RenderThread::stats() {
+    lock_guard<mutex> lock(this->_mtx);
+    return this->_stats;
+}
+
+
+/** @brief Give back a capture to be reused by acquire()
+ */
+void RenderThread::_recycle(unique_ptr<FrameCapture> capture) {
+    lock_guard<mutex> lock(this->_mtx);
+    this->_recycled.push_back(move(capture));
+}
+
+
+/** @brief Loop of render thread: render captures until the queue is closed
+ */
+void RenderThread::_workerLoop() {
+    unique_ptr<FrameCapture> capture;
+    while (this->_queue.pop(capture)) {
+        bool ok = true;
+        try {
+            int width = capture->size_x * capture->zoom_factor;
+            int height = capture->size_y * capture->zoom_factor;
+            bool incremental = !capture->full && this->_frame_valid;
+            if ((this->_frame.get_width() != width) || (this->_frame.get_height() != height)) {
+                this->_frame = TGAImage(width, height, TGAImage::RGB);
+                incremental = false;
+            }
+            this->_frame_valid = false;
+            if (incremental)
+                renderCells(*capture, this->_frame.buffer());
+            else
+                renderFrame(*capture, this->_frame.buffer());
+            this->_frame_valid = true;
+            this->_output(*capture, this->_frame);
+        } catch (exception& e) {
+            cerr << "frame " << capture->time << " not drawn: " << e.what() << endl;
+            ok = false;
+        }
+        {
+            lock_guard<mutex> lock(this->_mtx);
+            if (ok)
+                this->_stats.rendered++;
+            else
+                this->_stats.failed++;
+            this->_stats.pending--;
+            this->_recycled.push_back(move(capture));
+        }
+        this->_cv_flushed.notify_all();
+    }
+}
@@ -0,0 +1,105 @@
+/** @file RenderThread.h
+ * @brief Header of RenderThread
+ *
+ * @ingroup core
+ */
+
+#ifndef RENDERTHREAD_H_INCLUDED
+#define RENDERTHREAD_H_INCLUDED
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include "FrameRenderer.h"
+#include "BoundedQueue.h"
+#include "tgaimage.hpp"
+
+using namespace std;
+
+
+/** @brief What submit() does when the render queue is full
+ */
+enum RenderQueuePolicy {
+    RENDER_QUEUE_BLOCK = 0,  // wait for the renderer: every frame is drawn
+    RENDER_QUEUE_DROP = 1    // discard the frame: the simulation never waits
+};
+
+/** @brief Counters of a RenderThread
+ */
+struct RenderThreadStats {
+    uint64_t submitted;
+    uint64_t rendered;
+    /** @brief Frames not drawn because rendering or output threw
+    */
+    uint64_t failed;
+    /** @brief Frames discarded because the queue was full (RENDER_QUEUE_DROP)
+    */
+    uint64_t dropped;
+    /** @brief Frames waiting to be rendered (including the one being rendered)
+    */
+    uint64_t pending;
+    /** @brief Maximum value of pending ever seen
+    */
+    uint64_t max_pending;
+    /** @brief Number of submit() calls which had to wait because the queue was full
+    */
+    uint64_t stalls;
+    /** @brief Time spent by submit() waiting for the renderer
+    */
+    double stall_ms;
+};
+
+
+/** @brief Background thread rendering frame captures and handing the images to an output
+ *
+ * The simulation thread takes a FrameCapture with acquire(), fills it
+ * with captureFrame() and hands it over with submit(). The render thread
+ * draws it into a TGAImage and calls the output function (which writes a
+ * .tga file, appends to a frame archive...). Captures are recycled, and
+ * frames are drawn into the same image every time (it is only reallocated
+ * if the frame size changes): every pixel is overwritten, so it is never
+ * cleared either. Captures which are not full (see captureChangedCells())
+ * only repaint their dirty cells over the previous frame, unless the
+ * previous frame was not drawn (dropped, failed or of another size).
+ *
+ * When the renderer falls behind and the queue is full, submit() either
+ * waits or drops the frame, as chosen by the RenderQueuePolicy.
+ *
+ * @ingroup core
+ */
+class RenderThread {
+public:
+    RenderThread(size_t queue_capacity, RenderQueuePolicy policy,
+                 function<void(const FrameCapture&, TGAImage&)> output);
+    ~RenderThread();
+    unique_ptr<FrameCapture> acquire();
+    void submit(unique_ptr<FrameCapture> capture);
+    void flush();
+    RenderThreadStats stats();
+private:
+    RenderQueuePolicy _policy;
+    function<void(const FrameCapture&, TGAImage&)> _output;
+    BoundedQueue<unique_ptr<FrameCapture>> _queue;
+    vector<unique_ptr<FrameCapture>> _recycled;
+    mutex _mtx;
+    condition_variable _cv_flushed;
+    RenderThreadStats _stats;
+    /** @brief Image where frames are drawn (only used by render thread)
+    */
+    TGAImage _frame;
+    /** @brief True if _frame holds the last capture popped (only used by render thread)
+    */
+    bool _frame_valid;
+    /** @brief True if a capture was dropped, so the next one is rendered in full
+    */
+    bool _force_full;
+    thread _worker;
+    void _workerLoop();
+    void _recycle(unique_ptr<FrameCapture> capture);
+};
+
+
+#endif  // RENDERTHREAD_H_INCLUDED
@@ -0,0 +1,284 @@
+/** @file Snapshot.cpp
+ * @brief Binary snapshots definition
+ *
+ * @ingroup core
+ */
+
+#include "Snapshot.h"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+const size_t SNAPSHOT_COLUMN_WIDTH[NUM_SNAPSHOT_COLUMNS] = {
+    sizeof(int32_t),   // SNAPSHOT_LOCATION_X
+    sizeof(int32_t),   // SNAPSHOT_LOCATION_Y
+    sizeof(uint8_t),   // SNAPSHOT_SPECIES
+    sizeof(int32_t),   // SNAPSHOT_AGE
+    sizeof(int32_t),   // SNAPSHOT_DEATH_AGE
+    sizeof(float),     // SNAPSHOT_ENERGY_RESERVE
+    sizeof(float),     // SNAPSHOT_INITIAL_ENERGY_RESERVE
+    sizeof(uint8_t)    // SNAPSHOT_FLAGS
+};
+
+/** @brief Round offset up to a multiple of 8
+ */
+static uint64_t _align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+
+/*********************************************************
+ * AlignedWriter implementation
+ */
+
+void AlignedWriter::_write(const void* data, uint64_t size) {
+    this->_out->write(static_cast<const char*>(data), size);
+    this->_position += size;
+}
+
+void AlignedWriter::_padTo(uint64_t offset) {
+    const char zeros[8] = {0};
+    this->_write(zeros, offset - this->_position);
+}
+
+
+/*********************************************************
+ * SnapshotWriter implementation
+ */
+
+/** @brief Initializer: write header and settings
+ *
+ * @param[in] out Output stream (binary)
+ * @param[in] time Ecosystem time
+ * @param[in] seed Seed of ecosystem random streams
+ * @param[in] num_organisms Number of organisms in every column
+ * @param[in] settings Ecosystem constants, as JSON text
+ */
+SnapshotWriter::SnapshotWriter(ostream& out, int32_t time, uint32_t seed, uint64_t num_organisms, const string& settings)
+    : AlignedWriter(out) {
+    this->_next_column = 0;
+    memset(&this->_header, 0, sizeof(SnapshotHeader));
+    memcpy(this->_header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    this->_header.version = SNAPSHOT_VERSION;
+    this->_header.byte_order = SNAPSHOT_BYTE_ORDER;
+    this->_header.time = time;
+    this->_header.seed = seed;
+    this->_header.num_organisms = num_organisms;
+    this->_header.settings_offset = _align8(sizeof(SnapshotHeader));
+    this->_header.settings_size = settings.size();
+    uint64_t offset = _align8(this->_header.settings_offset + settings.size());
+    for (int c = 0; c < NUM_SNAPSHOT_COLUMNS; c++) {
+        this->_header.column_offset[c] = offset;
+        offset = _align8(offset + num_organisms * SNAPSHOT_COLUMN_WIDTH[c]);
+    }
+    this->_write(&this->_header, sizeof(SnapshotHeader));
+    this->_padTo(this->_header.settings_offset);
+    this->_write(settings.data(), settings.size());
+}
+
+/** @brief Write next column
+ *
+ * @param[in] column Column to be written (columns must be written in order)
+ * @param[in] data Array of num_organisms values of the column type
+ */
+void SnapshotWriter::writeColumn(SnapshotColumn column, const void* data) {
+    if (column != this->_next_column)
+        throw logic_error("snapshot columns must be written in order");
+    this->_padTo(this->_header.column_offset[column]);
+    this->_write(data, this->_header.num_organisms * SNAPSHOT_COLUMN_WIDTH[column]);
+    this->_next_column++;
+    if (this->_next_column == NUM_SNAPSHOT_COLUMNS)
+        this->_padTo(_align8(this->_position));
+}
+
+
+/*********************************************************
+ * DeltaWriter implementation
+ */
+
+/** @brief Initializer: write header
+ *
+ * @param[in] out Output stream (binary)
+ * @param[in] time Ecosystem time
+ * @param[in] base_time Time of the checkpoint this delta is relative to
+ * @param[in] seed Seed of ecosystem random streams
+ * @param[in] num_removed Number of organisms of base list removed
+ * @param[in] num_kept Number of organisms of base list kept
+ * @param[in] num_added Number of organisms added
+ */
+DeltaWriter::DeltaWriter(ostream& out, int32_t time, int32_t base_time, uint32_t seed,
+                         uint64_t num_removed, uint64_t num_kept, uint64_t num_added) : AlignedWriter(out) {
+    memset(&this->_header, 0, sizeof(DeltaHeader));
+    memcpy(this->_header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC));
+    this->_header.version = SNAPSHOT_VERSION;
+    this->_header.byte_order = SNAPSHOT_BYTE_ORDER;
+    this->_header.time = time;
+    this->_header.base_time = base_time;
+    this->_header.seed = seed;
+    this->_header.num_removed = num_removed;
+    this->_header.num_kept = num_kept;
+    this->_header.num_added = num_added;
+    this->_header.removed_offset = _align8(sizeof(DeltaHeader));
+    this->_header.kept_energy_reserve_offset = _align8(this->_header.removed_offset + num_removed * sizeof(uint32_t));
+    uint64_t offset = _align8(this->_header.kept_energy_reserve_offset + num_kept * sizeof(float));
+    for (int c = 0; c < NUM_SNAPSHOT_COLUMNS; c++) {
+        this->_header.added_column_offset[c] = offset;
+        offset = _align8(offset + num_added * SNAPSHOT_COLUMN_WIDTH[c]);
+    }
+    this->_write(&this->_header, sizeof(DeltaHeader));
+}
+
+/** @brief Write positions in base list of removed organisms
+ */
+void DeltaWriter::writeRemoved(const uint32_t* removed) {
+    this->_padTo(this->_header.removed_offset);
+    this->_write(removed, this->_header.num_removed * sizeof(uint32_t));
+}
+
+/** @brief Write new energy_reserve of kept organisms
+ */
+void DeltaWriter::writeKeptEnergyReserve(const float* energy_reserve) {
+    this->_padTo(this->_header.kept_energy_reserve_offset);
+    this->_write(energy_reserve, this->_header.num_kept * sizeof(float));
+}
+
+/** @brief Write next column of added organisms (columns must be written in order)
+ */
+void DeltaWriter::writeAddedColumn(SnapshotColumn column, const void* data) {
+    this->_padTo(this->_header.added_column_offset[column]);
+    this->_write(data, this->_header.num_added * SNAPSHOT_COLUMN_WIDTH[column]);
+    if (column == NUM_SNAPSHOT_COLUMNS - 1)
+        this->_padTo(_align8(this->_position));
+}
+
+
+/*********************************************************
+ * MappedFile implementation
+ */
+
+/** @brief Initializer: map a file in memory
+ *
+ * @param[in] path Path of the file to be mapped (read-only)
+ */
+MappedFile::MappedFile(const string& path) : _data(nullptr), _size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("can't open " + path + ": " + strerror(errno));
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("can't stat " + path + ": " + strerror(errno));
+    }
+    this->_size = (size_t)file_stat.st_size;
+    if (this->_size > 0) {
+        void* data = mmap(nullptr, this->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("can't map " + path + ": " + strerror(errno));
+        }
+        madvise(data, this->_size, MADV_SEQUENTIAL);  // columns are read front to back
+        this->_data = static_cast<const char*>(data);
+    }
+    close(fd);  // the mapping keeps the file referenced
+}
+
+/** @brief Destructor: unmap the file
+ */
+MappedFile::~MappedFile() {
+    if (this->_data != nullptr)
+        munmap(const_cast<char*>(this->_data), this->_size);
+}
+
+
+/*********************************************************
+ * DeltaView implementation
+ */
+
+/** @brief Initializer: check that data holds a complete delta snapshot
+ *
+ * @param[in] data Delta bytes (must be 8-byte aligned and outlive the view)
+ * @param[in] size Number of bytes in data
+ */
+DeltaView::DeltaView(const char* data, size_t size) : _data(data), _size(size) {
+    if ((size < sizeof(DeltaHeader)) || (memcmp(data, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0))
+        throw runtime_error("not an ecosystem delta snapshot");
+    const DeltaHeader& header = this->header();
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER)
+        throw runtime_error("delta snapshot written with a different byte order");
+    if (header.version != SNAPSHOT_VERSION)
+        throw runtime_error("unsupported delta snapshot version " + to_string(header.version));
+    if (!sectionFits(header.removed_offset, header.num_removed, sizeof(uint32_t), size) ||
+        !sectionFits(header.kept_energy_reserve_offset, header.num_kept, sizeof(float), size))
+        throw runtime_error("truncated delta snapshot");
+    for (int c = 0; c < NUM_SNAPSHOT_COLUMNS; c++) {
+        if (!sectionFits(header.added_column_offset[c], header.num_added, SNAPSHOT_COLUMN_WIDTH[c], size))
+            throw runtime_error("truncated delta snapshot");
+    }
+}
+
+/** @brief Get delta header
+ */
+const DeltaHeader& DeltaView::header() const {
+    return *reinterpret_cast<const DeltaHeader*>(this->_data);
+}
+
+/** @brief Get positions in base list of removed organisms (header().num_removed values)
+ */
+const uint32_t* DeltaView::removed() const {
+    return reinterpret_cast<const uint32_t*>(this->_data + this->header().removed_offset);
+}
+
+/** @brief Get new energy_reserve of kept organisms (header().num_kept values)
+ */
+const float* DeltaView::keptEnergyReserve() const {
+    return reinterpret_cast<const float*>(this->_data + this->header().kept_energy_reserve_offset);
+}
+
+
+/*********************************************************
+ * SnapshotView implementation
+ */
+
+/** @brief Initializer: check that data holds a complete snapshot
+ *
+ * @param[in] data Snapshot bytes (must be 8-byte aligned and outlive the view)
+ * @param[in] size Number of bytes in data
+ */
+SnapshotView::SnapshotView(const char* data, size_t size) : _data(data), _size(size) {
+    if ((size < sizeof(SnapshotHeader)) || (memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0))
+        throw runtime_error("not an ecosystem snapshot");
+    const SnapshotHeader& header = this->header();
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER)
+        throw runtime_error("snapshot written with a different byte order");
+    if (header.version != SNAPSHOT_VERSION)
+        throw runtime_error("unsupported snapshot version " + to_string(header.version));
+    if (!sectionFits(header.settings_offset, header.settings_size, 1, size))
+        throw runtime_error("truncated snapshot");
+    for (int c = 0; c < NUM_SNAPSHOT_COLUMNS; c++) {
+        if (!sectionFits(header.column_offset[c], header.num_organisms, SNAPSHOT_COLUMN_WIDTH[c], size))
+            throw runtime_error("truncated snapshot");
+    }
+}
+
+/** @brief Get snapshot header
+ */
+const SnapshotHeader& SnapshotView::header() const {
+    return *reinterpret_cast<const SnapshotHeader*>(this->_data);
+}
+
+/** @brief Get ecosystem constants, as JSON text
+ */
+string SnapshotView::settings() const {
+    return string(this->_data + this->header().settings_offset, this->header().settings_size);
+}
+
+/** @brief Get number of organisms in every column
+ */
+uint64_t SnapshotView::numOrganisms() const {
+    return this->header().num_organisms;
+}
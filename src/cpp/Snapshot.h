@@ -0,0 +1,223 @@
+/** @file Snapshot.h
+ * @brief Header of binary snapshots
+ *
+ * @ingroup core
+ */
+
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <ostream>
+
+using namespace std;
+
+
+/** @brief Organism columns of a binary snapshot, in file order
+ */
+enum SnapshotColumn {
+    SNAPSHOT_LOCATION_X = 0,             // int32_t
+    SNAPSHOT_LOCATION_Y,                 // int32_t
+    SNAPSHOT_SPECIES,                    // uint8_t: SpeciesId (index in constants.SPECIES)
+    SNAPSHOT_AGE,                        // int32_t
+    SNAPSHOT_DEATH_AGE,                  // int32_t
+    SNAPSHOT_ENERGY_RESERVE,             // float
+    SNAPSHOT_INITIAL_ENERGY_RESERVE,     // float
+    SNAPSHOT_FLAGS,                      // uint8_t: SNAPSHOT_FLAG_* bits
+    NUM_SNAPSHOT_COLUMNS
+};
+
+const uint8_t SNAPSHOT_FLAG_ENERGY_DEPENDENT = 0x01;
+
+/** @brief Bytes per organism of each column
+ */
+extern const size_t SNAPSHOT_COLUMN_WIDTH[NUM_SNAPSHOT_COLUMNS];
+
+/** @brief Fixed-size header at the beginning of a binary snapshot
+ *
+ * It is followed by the settings ("constants" JSON, as text) and by the
+ * columns of living organisms in biotope (row-major) order. Every section
+ * starts at an offset multiple of 8, so a snapshot mapped in memory can be
+ * read in place. Integers are stored in the byte order of the writer, which
+ * is checked through byte_order.
+ *
+ * @ingroup core
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t time;
+    uint32_t seed;
+    uint64_t num_organisms;
+    uint64_t settings_offset;
+    uint64_t settings_size;
+    uint64_t column_offset[NUM_SNAPSHOT_COLUMNS];
+};
+
+/** @brief Fixed-size header at the beginning of a delta snapshot
+ *
+ * A delta rebuilds the living organisms at time from those of the
+ * checkpoint (full or delta) at base_time, whose list of organisms in
+ * biotope order is the base list:
+ * - removed: positions in base list of organisms dead or moved (uint32_t)
+ * - kept: organisms of base list not removed, in the same order; their age
+ *   increased by (time - base_time) and their new energy_reserve is stored
+ *   in a float column
+ * - added: organisms born or moved, in biotope order, stored in the same
+ *   columns as a full snapshot (without settings)
+ * Sections are 8-byte aligned as in full snapshots.
+ *
+ * @ingroup core
+ */
+struct DeltaHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t time;
+    int32_t base_time;
+    uint32_t seed;
+    uint32_t reserved;
+    uint64_t num_removed;
+    uint64_t num_kept;
+    uint64_t num_added;
+    uint64_t removed_offset;
+    uint64_t kept_energy_reserve_offset;
+    uint64_t added_column_offset[NUM_SNAPSHOT_COLUMNS];
+};
+
+const char SNAPSHOT_MAGIC[8] = {'E', 'C', 'O', 'S', 'N', 'A', 'P', '\0'};
+const char DELTA_MAGIC[8] = {'E', 'C', 'O', 'D', 'E', 'L', 'T', 'A'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+/** @brief Check that num items of width bytes starting at offset lie within size bytes
+ *
+ * Written so that huge values read from a corrupted header can't overflow.
+ */
+inline bool sectionFits(uint64_t offset, uint64_t num, uint64_t width, uint64_t size) {
+    return (offset <= size) && (num <= (size - offset) / width);
+}
+
+
+/** @brief Sequential writer of 8-byte aligned sections
+ *
+ * @ingroup core
+ */
+class AlignedWriter {
+public:
+    AlignedWriter(ostream& out) : _out(&out), _position(0) {}
+protected:
+    ostream* _out;
+    uint64_t _position;
+    void _write(const void* data, uint64_t size);
+    void _padTo(uint64_t offset);
+};
+
+
+/** @brief Sequential writer of a binary snapshot
+ *
+ * Header and settings are written by the constructor; then every column
+ * must be written, in SnapshotColumn order.
+ *
+ * @ingroup core
+ */
+class SnapshotWriter : public AlignedWriter {
+public:
+    SnapshotWriter(ostream& out, int32_t time, uint32_t seed, uint64_t num_organisms, const string& settings);
+    void writeColumn(SnapshotColumn column, const void* data);
+private:
+    SnapshotHeader _header;
+    int _next_column;
+};
+
+
+/** @brief Sequential writer of a delta snapshot
+ *
+ * Header is written by the constructor; then removed positions, kept
+ * energies and every column of added organisms (in SnapshotColumn order).
+ *
+ * @ingroup core
+ */
+class DeltaWriter : public AlignedWriter {
+public:
+    DeltaWriter(ostream& out, int32_t time, int32_t base_time, uint32_t seed,
+                uint64_t num_removed, uint64_t num_kept, uint64_t num_added);
+    void writeRemoved(const uint32_t* removed);
+    void writeKeptEnergyReserve(const float* energy_reserve);
+    void writeAddedColumn(SnapshotColumn column, const void* data);
+private:
+    DeltaHeader _header;
+};
+
+
+/** @brief Read-only memory mapping of a whole file (POSIX mmap)
+ *
+ * Pages are loaded on demand by the kernel and belong to the page cache, so
+ * reading a mapped snapshot needs no copy of the file in the process heap.
+ *
+ * @ingroup core
+ */
+class MappedFile {
+public:
+    MappedFile(const string& path);
+    ~MappedFile();
+    const char* data() const { return this->_data; }
+    size_t size() const { return this->_size; }
+private:
+    const char* _data;
+    size_t _size;
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+
+/** @brief Read-only view of a delta snapshot held in memory (not owned)
+ *
+ * @ingroup core
+ */
+class DeltaView {
+public:
+    DeltaView(const char* data, size_t size);
+    const DeltaHeader& header() const;
+    const uint32_t* removed() const;
+    const float* keptEnergyReserve() const;
+
+    /** @brief Get a column of added organisms as an array of header().num_added values of type T
+    */
+    template <typename T>
+    const T* addedColumn(SnapshotColumn column) const {
+        return reinterpret_cast<const T*>(this->_data + this->header().added_column_offset[column]);
+    }
+private:
+    const char* _data;
+    size_t _size;
+};
+
+
+/** @brief Read-only view of a binary snapshot held in memory (not owned)
+ *
+ * @ingroup core
+ */
+class SnapshotView {
+public:
+    SnapshotView(const char* data, size_t size);
+    const SnapshotHeader& header() const;
+    string settings() const;
+    uint64_t numOrganisms() const;
+
+    /** @brief Get a column as an array of numOrganisms() values of type T
+    */
+    template <typename T>
+    const T* column(SnapshotColumn column) const {
+        return reinterpret_cast<const T*>(this->_data + this->header().column_offset[column]);
+    }
+private:
+    const char* _data;
+    size_t _size;
+};
+
+
+#endif  // SNAPSHOT_H_INCLUDED
@@ -0,0 +1,106 @@
+/** @file ThreadPool.cpp
+ * @brief ThreadPool definition
+ *
+ * @ingroup core
+ */
+
+#include "ThreadPool.h"
+
+
+/** @brief Initializer
+ *
+ * @param[in] num_threads Number of threads running parallel loops (including caller)
+ */
+ThreadPool::ThreadPool(int num_threads) : _task(nullptr), _num_tasks(0), _next_task(0),
+                                          _active_workers(0), _generation(0), _stop(false) {
+    for (int i = 1; i < num_threads; i++)
+        _workers.push_back(thread(&ThreadPool::_workerLoop, this));
+}
+
+
+/** @brief Destructor: stop and join all workers
+ */
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(_mtx);
+        _stop = true;
+    }
+    _cv_start.notify_all();
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+
+/** @brief Run task(0), task(1), ... task(num_tasks - 1) in parallel
+ *
+ * It returns when all tasks are done. Tasks are taken in increasing order,
+ * but they can finish in any order. The first exception thrown by a task
+ * is rethrown (after all running tasks are done).
+ *
+ * @param[in] num_tasks Number of tasks
+ * @param[in] task Function to run for each task index
+ */
+void ThreadPool::parallelFor(int num_tasks, const function<void(int)>& task) {
+    if (_workers.empty() || (num_tasks <= 1)) {
+        for (int i = 0; i < num_tasks; i++)
+            task(i);
+        return;
+    }
+    {
+        lock_guard<mutex> lock(_mtx);
+        _task = &task;
+        _num_tasks = num_tasks;
+        _next_task = 0;
+        _active_workers = (int)_workers.size();
+        _generation += 1;
+    }
+    _cv_start.notify_all();
+    _runTasks();
+    unique_lock<mutex> lock(_mtx);
+    _cv_done.wait(lock, [this] { return _active_workers == 0; });
+    _task = nullptr;
+    exception_ptr exception = _exception;
+    _exception = nullptr;
+    lock.unlock();
+    if (exception)
+        rethrow_exception(exception);
+}
+
+
+/** @brief Main loop of worker threads
+ */
+void ThreadPool::_workerLoop() {
+    uint64_t last_generation = 0;
+    while (true) {
+        unique_lock<mutex> lock(_mtx);
+        _cv_start.wait(lock, [&] { return _stop || (_generation != last_generation); });
+        if (_stop)
+            return;
+        last_generation = _generation;
+        lock.unlock();
+        _runTasks();
+        lock.lock();
+        _active_workers -= 1;
+        if (_active_workers == 0)
+            _cv_done.notify_one();
+    }
+}
+
+
+/** @brief Run pending tasks of current parallelFor() call until there are none left
+ *
+ * An exception thrown by a task is kept for parallelFor(), and the tasks
+ * not started yet are skipped.
+ */
+void ThreadPool::_runTasks() {
+    int i;
+    try {
+        while ((i = _next_task.fetch_add(1)) < _num_tasks)
+            (*_task)(i);
+    } catch (...) {
+        _next_task = _num_tasks;
+        lock_guard<mutex> lock(_mtx);
+        if (!_exception)
+            _exception = current_exception();
+    }
+}
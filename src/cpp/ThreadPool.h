@@ -0,0 +1,63 @@
+/** @file ThreadPool.h
+ * @brief Header of ThreadPool
+ *
+ * @ingroup core
+ */
+
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+using namespace std;
+
+
+/** @brief Fixed set of worker threads running parallel loops
+ *
+ * The thread calling parallelFor() works too, so a pool of size N creates
+ * N - 1 worker threads. A pool of size 1 runs everything serially.
+ *
+ * If a task throws, the tasks not started yet are skipped and parallelFor()
+ * rethrows the exception once every worker is done.
+ *
+ * @ingroup core
+ */
+class ThreadPool {
+public:
+    ThreadPool(int num_threads);
+    ~ThreadPool();
+    int size() const { return (int)_workers.size() + 1; }
+    void parallelFor(int num_tasks, const function<void(int)>& task);
+private:
+    vector<thread> _workers;
+    mutex _mtx;
+    condition_variable _cv_start;
+    condition_variable _cv_done;
+    /** @brief Task of current parallelFor() call (nullptr if none)
+     */
+    const function<void(int)>* _task;
+    int _num_tasks;
+    atomic<int> _next_task;
+    /** @brief Number of workers still running current parallelFor() call
+     */
+    int _active_workers;
+    /** @brief First exception thrown by a task of current parallelFor() call
+     */
+    exception_ptr _exception;
+    /** @brief Increased for every parallelFor() call, to wake workers up
+     */
+    uint64_t _generation;
+    bool _stop;
+    void _workerLoop();
+    void _runTasks();
+};
+
+
+#endif  // THREADPOOL_H_INCLUDED
@@ -8,7 +8,9 @@
 using namespace std;
 using json = nlohmann::json;
 
-default_random_engine eng((random_device())());
+/** @brief Neighborhood mask bits of the 8 cells around the center (bit 4)
+*/
+const unsigned int NEIGHBORS_MASK = 0x1EF;
 
 json default_settings;
 
@@ -128,29 +130,527 @@ void set_default_settings()
     default_settings["constants"]["FOOD_WEB"] = _FOOD_WEB;
     default_settings["state"]["time"] = 0;
     default_settings["constants"]["BACKUP_PERIOD"] = 50;
+    default_settings["constants"]["BACKUP_FORMAT"] = "zjson";
+    default_settings["constants"]["BACKUP_KEYFRAME_PERIOD"] = 500;
+    default_settings["constants"]["BACKUP_COMPRESSION"] = {
+        {"level", 1},
+        {"block_size", 1 << 20},
+        {"num_threads", 4}
+    };
     default_settings["constants"]["DRAWING_PERIOD"] = 1;
     default_settings["constants"]["DRAWING_ZOOM_FACTOR"] = 1;
+    default_settings["constants"]["DRAWING_FORMAT"] = "tga";
+    default_settings["constants"]["DRAWING_STREAM"] = {
+        {"path", "-"},
+        {"fps", 25}
+    };
+    default_settings["constants"]["DRAWING_QUEUE"] = {
+        {"capacity", 2},
+        {"policy", "block"}
+    };
+    default_settings["constants"]["DRAWING_INCREMENTAL"] = true;
+    default_settings["constants"]["DRAWING_ENCODER_THREADS"] = 4;
+    default_settings["constants"]["PARALLEL_SETTINGS"] = {
+        {"num_threads", 1},
+        {"tile_size_x", 32},
+        {"tile_size_y", 32},
+        {"num_tile_colors", 2}
+    };
     
-    ostringstream str_random;
-    str_random << eng;
-    default_settings["state"]["RANDOM_ENG"] = str_random.str();
+    default_settings["state"]["SEED"] = (random_device())();
 
 }
 
-float evaluateRandomFunction(vector<string> definition) {
+/** @brief Parse a random function definition
+*
+* @param[in] definition Distribution name and its parameters, e.g. {"uniform_int", "0", "30"}
+*/
+RandomFunction::RandomFunction(const vector<string>& definition) : distribution(UNKNOWN), min_value(0), max_value(0) {
     string distributionName = definition[0];
-    string valStr1 = definition[1];
-    string valStr2 = definition[2];
     if (distributionName == "uniform_int") {
-        int minVal = stoi(valStr1);
-        int maxVal = stoi(valStr2);
-        uniform_int_distribution<int> distribution(minVal, maxVal);
-        return (float)distribution(eng);
+        this->distribution = UNIFORM_INT;
+        this->min_value = stoi(definition[1]);
+        this->max_value = stoi(definition[2]);
     } else {
         cout << "unknown distribution!" << endl;
     }
+}
+
+/** @brief Get a random value following this random function
+*
+* @param[in] random Random stream used to draw the value
+*/
+float RandomFunction::evaluate(RandomStream& random) const {
+    if (this->distribution == UNIFORM_INT)
+        return (float)random.uniformInt(this->min_value, this->max_value);
     return 0.0f;
 }
+
+/*********************************************************
+ * SpeciesRegistry implementation
+ */
+
+/** @brief Build registry assigning IDs 0, 1, 2... to a list of species names
+*
+* @param[in] names Species names (typically constant SPECIES)
+*/
+SpeciesRegistry::SpeciesRegistry(const vector<string>& names) {
+    if (names.size() > MAX_SPECIES)
+        cerr << "too many species! only the first " << MAX_SPECIES << " are used" << endl;
+    for (const string& name : names) {
+        if ((this->_names.size() == MAX_SPECIES) || (this->_ids.count(name) > 0))
+            continue;
+        this->_ids[name] = (SpeciesId)this->_names.size();
+        this->_names.push_back(name);
+    }
+}
+
+/*********************************************************
+ * CompiledSettings implementation
+ */
+
+/** @brief Build compiled settings from the constants of a settings JSON
+*
+* @param[in] settings_json Settings (as in Ecosystem::settings_json)
+*/
+CompiledSettings::CompiledSettings(const json& settings_json) {
+    const json& constants = settings_json.at("constants");
+    const json& energy_cost = constants.at("ENERGY_COST");
+    const json& minimum_energy_required_to = constants.at("MINIMUM_ENERGY_REQUIRED_TO");
+    const char* action_names[NUM_ORGANISM_ACTIONS] = {"move", "hunt", "procreate"};
+    const char* capability_names[NUM_ORGANISM_ACTIONS] = {"moving", "hunting", "procreating"};
+    for (int action = 0; action < NUM_ORGANISM_ACTIONS; action++) {
+        this->energy_cost_of_capability_to[action] = float(energy_cost.at(string("to have the capability of ") + capability_names[action]));
+        this->energy_cost_to[action] = float(energy_cost.at(string("to ") + action_names[action]));
+        this->minimum_energy_required_to[action] = float(minimum_energy_required_to.at(action_names[action]));
+    }
+
+    this->species = SpeciesRegistry(constants.at("SPECIES").get<vector<string>>());
+    for (const string& name : this->species.names()) {
+        this->can_move.push_back((name != PLANT) && (name != CARNIVORE3));
+        this->can_hunt.push_back(name != PLANT);
+        this->photosynthesis_capacity.push_back(float(constants.at("PHOTOSYNTHESIS_CAPACITY").at(name)));
+        this->procreation_probability.push_back(float(constants.at("PROCREATION_PROBABILITY").at(name)));
+        this->death_age.push_back(RandomFunction(constants.at("DEATH_AGE").at(name).get<vector<string>>()));
+        this->initial_num_of_organisms.push_back(int(constants.at("INITIAL_NUM_OF_ORGANISMS").at(name)));
+    }
+
+    // Food web as a predator -> prey bit matrix (unknown species are ignored)
+    this->prey_mask.assign(this->species.size(), SpeciesMask());
+    for (auto predator = constants.at("FOOD_WEB").begin(); predator != constants.at("FOOD_WEB").end(); ++predator) {
+        if (!this->species.contains(predator.key()))
+            continue;
+        SpeciesMask& mask = this->prey_mask[this->species.id(predator.key())];
+        for (const string& prey : predator.value().get<vector<string>>()) {
+            if (this->species.contains(prey))
+                mask.set(this->species.id(prey));
+        }
+    }
+
+    this->initial_energy_reserve = float(constants.at("INITIAL_ENERGY_RESERVE"));
+    // Experiments created before PARALLEL_SETTINGS existed evolve serially
+    json parallel_settings = constants.count("PARALLEL_SETTINGS") ? constants.at("PARALLEL_SETTINGS") : json::object();
+    this->num_threads = parallel_settings.value("num_threads", 1);
+    this->tile_size_x = parallel_settings.value("tile_size_x", 32);
+    this->tile_size_y = parallel_settings.value("tile_size_y", 32);
+    this->num_tile_colors = parallel_settings.value("num_tile_colors", 2);
+    this->backup_period = int(constants.at("BACKUP_PERIOD"));
+    string backup_format = constants.value("BACKUP_FORMAT", string("zjson"));
+    if (backup_format == "zjson")
+        this->backup_formats = BACKUP_ZJSON;
+    else if (backup_format == "binary")
+        this->backup_formats = BACKUP_BINARY;
+    else if (backup_format == "both")
+        this->backup_formats = BACKUP_ZJSON | BACKUP_BINARY;
+    else
+        throw invalid_argument("unknown BACKUP_FORMAT: " + backup_format);
+    this->backup_keyframe_period = constants.value("BACKUP_KEYFRAME_PERIOD", this->backup_period);
+    if (this->backup_keyframe_period <= 0)
+        throw invalid_argument("BACKUP_KEYFRAME_PERIOD must be positive: " + to_string(this->backup_keyframe_period));
+    // Experiments created before BACKUP_COMPRESSION existed keep uncompressed binary backups
+    json backup_compression = constants.count("BACKUP_COMPRESSION") ? constants.at("BACKUP_COMPRESSION") : json::object();
+    this->backup_compression_level = backup_compression.value("level", 0);
+    this->backup_block_size = backup_compression.value("block_size", 1 << 20);
+    this->backup_compression_threads = backup_compression.value("num_threads", 1);
+    this->drawing_period = int(constants.at("DRAWING_PERIOD"));
+    this->drawing_zoom_factor = int(constants.at("DRAWING_ZOOM_FACTOR"));
+    string drawing_format = constants.value("DRAWING_FORMAT", string("tga"));
+    if (drawing_format == "tga")
+        this->drawing_format = DRAWING_TGA;
+    else if (drawing_format == "archive")
+        this->drawing_format = DRAWING_ARCHIVE;
+    else if (drawing_format == "y4m")
+        this->drawing_format = DRAWING_Y4M;
+    else if (drawing_format == "rgb")
+        this->drawing_format = DRAWING_RGB;
+    else
+        throw invalid_argument("unknown DRAWING_FORMAT: " + drawing_format);
+    json drawing_stream = constants.count("DRAWING_STREAM") ? constants.at("DRAWING_STREAM") : json::object();
+    this->drawing_stream_path = drawing_stream.value("path", string("-"));
+    this->drawing_stream_fps = drawing_stream.value("fps", 25);
+    json drawing_queue = constants.count("DRAWING_QUEUE") ? constants.at("DRAWING_QUEUE") : json::object();
+    this->drawing_queue_capacity = drawing_queue.value("capacity", 2);
+    string drawing_queue_policy = drawing_queue.value("policy", string("block"));
+    if ((drawing_queue_policy != "block") && (drawing_queue_policy != "drop"))
+        throw invalid_argument("unknown DRAWING_QUEUE policy: " + drawing_queue_policy);
+    this->drawing_drop_frames = (drawing_queue_policy == "drop");
+    this->drawing_incremental = constants.value("DRAWING_INCREMENTAL", true);
+    this->drawing_encoder_threads = constants.value("DRAWING_ENCODER_THREADS", 1);
+}
+
+/*********************************************************
+ * OrganismStore implementation
+ */
+
+/** @brief OrganismStore constructor (empty store)
+*/
+OrganismStore::OrganismStore() : _max_live(0) {}
+
+/** @brief Get a slot for a new organism
+*
+* A slot freed by destroy() is reused if available. Otherwise all columns
+* grow by one element. Attributes of the new slot must be set by the caller.
+*
+* @returns Handle of the new organism
+*/
+OrganismHandle OrganismStore::create() {
+    if (!this->_free_slots.empty()) {
+        uint32_t index = this->_free_slots.back();
+        this->_free_slots.pop_back();
+        this->_max_live = max(this->_max_live, this->size() - this->_retired.size());
+        return OrganismHandle(index, this->generation[index]);
+    }
+    uint32_t index = (uint32_t)this->generation.size();
+    this->energy_reserve.push_back(0.0f);
+    this->age.push_back(0);
+    this->death_age.push_back(0);
+    this->location.push_back(make_tuple(0, 0));
+    this->is_alive.push_back(0);
+    this->is_energy_dependent.push_back(0);
+    this->photosynthesis_capacity.push_back(0.0f);
+    this->initial_energy_reserve.push_back(0.0f);
+    this->old_location.push_back(make_tuple(0, 0));
+    this->species.push_back(0);
+    this->cause_of_death.push_back("");
+    this->generation.push_back(0);
+    this->_max_live = max(this->_max_live, this->size() - this->_retired.size());
+    return OrganismHandle(index, 0);
+}
+
+/** @brief Free the slot of an organism
+*
+* Its generation is increased, so handles to it are no longer valid.
+*
+* @param[in] handle Handle of organism to be destroyed
+*/
+void OrganismStore::destroy(OrganismHandle handle) {
+    if (!this->isValid(handle))
+        return;
+    this->generation[handle.index] += 1;
+    this->is_alive[handle.index] = 0;
+    this->_free_slots.push_back(handle.index);
+}
+
+/** @brief Queue a dead organism to be destroyed at the next iteration boundary
+*
+* Its data stays readable (e.g. to serialize dead organisms) until recycle()
+* is called.
+*
+* @param[in] handle Handle of dead organism
+*/
+void OrganismStore::retire(OrganismHandle handle) {
+    this->_retired.push_back(handle);
+}
+
+/** @brief Destroy all retired organisms, so their slots can be reused
+*
+* It must be called at iteration boundaries. Slots are pushed in reverse
+* order so that they are reused in the same order they were retired.
+*/
+void OrganismStore::recycle() {
+    for (auto it = this->_retired.rbegin(); it != this->_retired.rend(); ++it)
+        this->destroy(*it);
+    this->_retired.clear();
+}
+
+/** @brief Allocate memory for a given number of slots in every column
+*
+* @param[in] capacity Number of slots
+*/
+void OrganismStore::reserve(size_t capacity) {
+    this->energy_reserve.reserve(capacity);
+    this->age.reserve(capacity);
+    this->death_age.reserve(capacity);
+    this->location.reserve(capacity);
+    this->is_alive.reserve(capacity);
+    this->is_energy_dependent.reserve(capacity);
+    this->photosynthesis_capacity.reserve(capacity);
+    this->initial_energy_reserve.reserve(capacity);
+    this->old_location.reserve(capacity);
+    this->species.reserve(capacity);
+    this->cause_of_death.reserve(capacity);
+    this->generation.reserve(capacity);
+}
+
+/** @brief Get occupancy statistics of the store
+*/
+OrganismPoolStats OrganismStore::stats() const {
+    OrganismPoolStats stats;
+    stats.capacity = this->capacity();
+    stats.free = this->_free_slots.size();
+    stats.retired = this->_retired.size();
+    stats.live = this->size() - stats.retired;
+    stats.max_live = this->_max_live;
+    return stats;
+}
+
+/** @brief Destroy all organisms and release memory of all columns
+*/
+void OrganismStore::clear() {
+    *this = OrganismStore();
+}
+
+/*********************************************************
+ * BiotopeGrid implementation
+ */
+
+/** @brief BiotopeGrid constructor (empty grid)
+*/
+BiotopeGrid::BiotopeGrid() : _size_x(0), _size_y(0), _num_organisms(0) {}
+
+/** @brief Resize grid, leaving all its cells free
+*
+* @param[in] size_x Size of biotope in X axis
+* @param[in] size_y Size of biotope in Y axis
+*/
+void BiotopeGrid::resize(int size_x, int size_y) {
+    this->_size_x = size_x;
+    this->_size_y = size_y;
+    this->_cells.assign(size_x * size_y, OrganismHandle());
+    this->_num_organisms = 0;
+}
+
+/** @brief Get organism at a given location, like std::map::at()
+*
+* @param[in] location <x, y> tuple
+* @returns Handle of the organism. Throws out_of_range if the cell is free
+*/
+OrganismHandle BiotopeGrid::at(const tuple<int, int>& location) const {
+    OrganismHandle organism = this->get(location);
+    if (organism.isNull())
+        throw out_of_range("BiotopeGrid::at: free location");
+    return organism;
+}
+
+/** @brief Find organism at a given location, like std::map::find()
+*
+* @param[in] location <x, y> tuple
+* @returns Iterator pointing to that cell, or end() if the cell is free
+*/
+BiotopeGrid::const_iterator BiotopeGrid::find(const tuple<int, int>& location) const {
+    int i = this->index(location);
+    return (!this->_cells[i].isNull()) ? const_iterator(this, i) : this->end();
+}
+
+/** @brief Occupy a free cell
+*/
+void BiotopeGrid::_place(int index, OrganismHandle organism) {
+    this->_cells[index] = organism;
+}
+
+/** @brief Free an occupied cell
+*
+* Number of organisms is not updated by _place() nor _clear(): Ecosystem
+* updates _num_organisms itself.
+*/
+void BiotopeGrid::_clear(int index) {
+    this->_cells[index] = OrganismHandle();
+}
+
+BiotopeGrid::const_iterator::const_iterator(const BiotopeGrid* grid, int index) : _grid(grid), _index(index) {
+    this->_skipFreeCells();
+}
+
+BiotopeGrid::value_type BiotopeGrid::const_iterator::operator*() const {
+    return value_type(this->_grid->location(this->_index), this->_grid->_cells[this->_index]);
+}
+
+BiotopeGrid::const_iterator& BiotopeGrid::const_iterator::operator++() {
+    this->_index += 1;
+    this->_skipFreeCells();
+    return *this;
+}
+
+void BiotopeGrid::const_iterator::_skipFreeCells() {
+    int num_cells = (int)this->_grid->_cells.size();
+    while ((this->_index < num_cells) && this->_grid->_cells[this->_index].isNull())
+        this->_index += 1;
+}
+
+/*********************************************************
+ * FreeLocationList implementation
+ */
+
+/** @brief FreeLocationList constructor (empty list)
+*/
+FreeLocationList::FreeLocationList() : _size_x(0) {}
+
+/** @brief Resize list to a given biotope, marking all its cells as free
+*
+* @param[in] size_x Size of biotope in X axis
+* @param[in] size_y Size of biotope in Y axis
+*/
+void FreeLocationList::resize(int size_x, int size_y) {
+    int num_cells = size_x * size_y;
+    this->_size_x = size_x;
+    this->_cells.resize(num_cells);
+    this->_slots.resize(num_cells);
+    for (int i = 0; i < num_cells; i++) {
+        this->_cells[i] = i;
+        this->_slots[i] = i;
+    }
+}
+
+/** @brief Mark a cell as free (no-op if it is already free)
+*
+* @param[in] index Cell index (y * size_x + x)
+*/
+void FreeLocationList::insert(int index) {
+    if (this->_slots[index] >= 0)
+        return;
+    this->_slots[index] = (int)this->_cells.size();
+    this->_cells.push_back(index);
+}
+
+/** @brief Mark a cell as occupied (no-op if it is not free)
+*
+* The last free cell is moved into the slot left by the erased one.
+*
+* @param[in] index Cell index (y * size_x + x)
+*/
+void FreeLocationList::erase(int index) {
+    int slot = this->_slots[index];
+    if (slot < 0)
+        return;
+    int last_index = this->_cells.back();
+    this->_cells[slot] = last_index;
+    this->_slots[last_index] = slot;
+    this->_cells.pop_back();
+    this->_slots[index] = -1;
+}
+
+/** @brief Get a free location chosen uniformly at random
+*
+* List must not be empty.
+*
+* @param[in] random Random stream used to draw the sample
+*/
+tuple<int, int> FreeLocationList::sample(RandomStream& random) const {
+    int index = this->_cells[random.uniformInt(0, (int)this->_cells.size() - 1)];
+    return make_tuple(index % this->_size_x, index / this->_size_x);
+}
+
+/*********************************************************
+ * OccupancyBitmap implementation
+ */
+
+/** @brief OccupancyBitmap constructor (empty bitmap)
+*/
+OccupancyBitmap::OccupancyBitmap() : _size_x(0), _size_y(0), _words_per_row(0) {}
+
+/** @brief Resize bitmap, leaving all its cells free
+*
+* @param[in] size_x Size of biotope in X axis
+* @param[in] size_y Size of biotope in Y axis
+*/
+void OccupancyBitmap::resize(int size_x, int size_y) {
+    this->_size_x = size_x;
+    this->_size_y = size_y;
+    this->_words_per_row = (size_x + 63) / 64;
+    int num_words = this->_words_per_row * size_y;
+    this->_words.reset(new atomic<uint64_t>[num_words]);
+    for (int i = 0; i < num_words; i++)
+        this->_words[i].store(0, memory_order_relaxed);
+}
+
+/** @brief Get occupancy of cells (x - 1, y), (x, y) and (x + 1, y) as 3 bits
+*
+* When the three cells lie in the same word (the usual case) a single word
+* load is needed. Cells at the left and right edges wrap around.
+*/
+unsigned int OccupancyBitmap::_rowBits(int x, int y) const {
+    int x_left = x - 1;
+    int x_right = x + 1;
+    if ((x_left >= 0) && (x_right < this->_size_x) && ((x_left >> 6) == (x_right >> 6)))
+        return (unsigned int)(this->_load(this->_word(x_left, y)) >> (x_left & 63)) & 7;
+    if (x_left < 0)
+        x_left += this->_size_x;
+    if (x_right >= this->_size_x)
+        x_right -= this->_size_x;
+    return (unsigned int)this->test(x_left, y)
+        | ((unsigned int)this->test(x, y) << 1)
+        | ((unsigned int)this->test(x_right, y) << 2);
+}
+
+/** @brief Get occupancy of the 3x3 neighborhood of a cell as a 9-bit mask
+*
+* @param[in] x X coordinate of center
+* @param[in] y Y coordinate of center
+* @returns Mask where bit (dy + 1) * 3 + (dx + 1) is set if cell
+* (x + dx, y + dy) is occupied
+*/
+unsigned int OccupancyBitmap::neighborhoodMask(int x, int y) const {
+    int y_up = (y == 0) ? this->_size_y - 1 : y - 1;
+    int y_down = (y == this->_size_y - 1) ? 0 : y + 1;
+    return this->_rowBits(x, y_up)
+        | (this->_rowBits(x, y) << 3)
+        | (this->_rowBits(x, y_down) << 6);
+}
+
+/*********************************************************
+ * DirtyCellBitmap implementation
+ */
+
+/** @brief DirtyCellBitmap constructor (empty bitmap)
+*/
+DirtyCellBitmap::DirtyCellBitmap() : _num_words(0) {}
+
+/** @brief Resize bitmap, leaving all its cells unchanged
+*
+* @param[in] num_cells Number of cells of biotope
+*/
+void DirtyCellBitmap::resize(int num_cells) {
+    this->_num_words = (num_cells + 63) / 64;
+    this->_words.reset(new atomic<uint64_t>[this->_num_words]);
+    this->clear();
+}
+
+/** @brief Forget all changes
+*/
+void DirtyCellBitmap::clear() {
+    for (int i = 0; i < this->_num_words; i++)
+        this->_words[i].store(0, memory_order_relaxed);
+}
+
+/** @brief Append the indices of changed cells (in increasing order) and forget them
+*
+* Must not run concurrently with mark().
+*
+* @param[out] cells Vector where cell indices are appended
+*/
+void DirtyCellBitmap::drain(vector<int>& cells) {
+    for (int i = 0; i < this->_num_words; i++) {
+        uint64_t word = this->_words[i].load(memory_order_relaxed);
+        if (word == 0)
+            continue;
+        this->_words[i].store(0, memory_order_relaxed);
+        while (word != 0) {
+            cells.push_back(i * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+}
+
 /*********************************************************
  * Ecosystem implementation
  */
@@ -165,13 +665,11 @@ Ecosystem::Ecosystem() {
     settings_json = default_settings;
     this->biotope_size_x = settings_json["constants"]["BIOTOPE_SETTINGS"]["size_x"];
     this->biotope_size_y = settings_json["constants"]["BIOTOPE_SETTINGS"]["size_y"];
+    this->time = settings_json["state"]["time"];
+    this->_initializeRandom();
+    this->compileSettings();
     this->_initializeBiotope();
     this->_initializeOrganisms();
-    this->time = settings_json["state"]["time"];
-    istringstream srandom;
-    string str_random = settings_json["state"]["RANDOM_ENG"];
-    srandom.str(str_random);
-    srandom >> eng;
 
 }
 
@@ -187,13 +685,52 @@ Ecosystem::Ecosystem(json data_json) {
     settings_json["state"] = data_json["state"];
     this->biotope_size_x = settings_json["constants"]["BIOTOPE_SETTINGS"]["size_x"];
     this->biotope_size_y = settings_json["constants"]["BIOTOPE_SETTINGS"]["size_y"];
+    this->time = settings_json["state"]["time"];
+    this->_initializeRandom();
+    this->compileSettings();
     this->_initializeBiotope();
     this->_initializeOrganisms(data_json);
-    this->time = settings_json["state"]["time"];
-    istringstream srandom;
-    string str_random = settings_json["state"]["RANDOM_ENG"];
-    srandom.str(str_random);
-    srandom >> eng;
+}
+
+/** @brief Ecosystem constructor using a binary snapshot
+*
+* Initialize biotope and create organisms straight from snapshot columns.
+*
+* @param[in] snapshot Binary snapshot of an ecosystem
+*/
+Ecosystem::Ecosystem(const SnapshotView& snapshot) {
+    this->_initializeFromColumns(json::parse(snapshot.settings()), snapshot.header().time,
+                                 snapshot.header().seed, OrganismColumns(snapshot));
+}
+
+/** @brief Ecosystem constructor using a capture
+*
+* Dead organisms of the capture are ignored.
+*
+* @param[in] capture Capture of an ecosystem (e.g. rebuilt from delta snapshots)
+*/
+Ecosystem::Ecosystem(const EcosystemCapture& capture) {
+    this->_initializeFromColumns(capture.constants, capture.time, capture.seed, OrganismColumns(capture.organisms));
+}
+
+/** @brief Initialize ecosystem from its constants, state and organism columns
+*
+* @param[in] constants Constants of settings_json
+* @param[in] time Ecosystem time
+* @param[in] seed Seed of random streams
+* @param[in] columns Attributes of living organisms
+*/
+void Ecosystem::_initializeFromColumns(const json& constants, int time, uint32_t seed, const OrganismColumns& columns) {
+    settings_json["constants"] = constants;
+    settings_json["state"]["time"] = time;
+    settings_json["state"]["SEED"] = seed;
+    this->biotope_size_x = settings_json["constants"]["BIOTOPE_SETTINGS"]["size_x"];
+    this->biotope_size_y = settings_json["constants"]["BIOTOPE_SETTINGS"]["size_y"];
+    this->time = time;
+    this->_initializeRandom();
+    this->compileSettings();
+    this->_initializeBiotope();
+    this->_initializeOrganisms(columns);
 }
 
 /** @brief get the settings whithin a JSON variable
@@ -205,142 +742,430 @@ json* Ecosystem::getSettings_json_ptr() {
     return sjp;
 }
 
+/** @brief Build compiled settings from settings_json
+*
+* It is called by constructors, and must be called again whenever constants
+* in settings_json are modified. Tiles and threads for parallel evolution
+* are (re)created too.
+*/
+void Ecosystem::compileSettings() {
+    this->_compiled_settings = CompiledSettings(this->settings_json);
+    this->_initializeTiles();
+}
+
+/** @brief Create a new organism (not added to ecosystem yet)
+*
+* @param[in] location Location of organism
+* @param[in] species Species identifier
+* @param[in] energy_reserve Amount of initial energy
+*
+* @returns Handle of the new organism in Ecosystem::organisms
+*/
+OrganismHandle Ecosystem::createOrganism(tuple<int, int> location, SpeciesId species, float energy_reserve) {
+    return this->createOrganism(location, species, energy_reserve, this->_serial_context);
+}
+
+/** @brief Create a new organism (not added to ecosystem yet) from a given context
+*
+* In deferred (parallel) contexts, slot allocation is serialized with a mutex.
+*
+* @param[in] location Location of organism
+* @param[in] species Species identifier
+* @param[in] energy_reserve Amount of initial energy
+* @param[in] context Context of the organism creating the new one
+*
+* @returns Handle of the new organism in Ecosystem::organisms
+*/
+OrganismHandle Ecosystem::createOrganism(tuple<int, int> location, SpeciesId species, float energy_reserve, EvolutionContext& context) {
+    OrganismHandle handle;
+    if (context.deferred) {
+        lock_guard<mutex> lock(this->_organisms_mtx);
+        handle = this->organisms.create();
+    } else {
+        handle = this->organisms.create();
+    }
+    uint32_t i = handle.index;
+
+    // Relative to parent_ecosystem:
+    this->organisms.location[i] = location;
+    this->organisms.old_location[i] = location;
+
+    // Genes:
+    this->organisms.photosynthesis_capacity[i] = this->_compiled_settings.photosynthesis_capacity[species];
+    this->organisms.death_age[i] = (int)this->_compiled_settings.death_age[species].evaluate(*context.random);
+    this->organisms.species[i] = species;
+
+    // State:
+    this->organisms.energy_reserve[i] = energy_reserve;
+    this->organisms.initial_energy_reserve[i] = energy_reserve;
+    this->organisms.is_alive[i] = 1;
+    this->organisms.age[i] = 0;
+    this->organisms.cause_of_death[i] = "";
+    this->organisms.is_energy_dependent[i] = 1;
+    return handle;
+}
+
 /** @brief Add organism to ecosystem
 *
+* @param[in] organism Handle of organism to be added to ecosystem
+*/
+void Ecosystem::addOrganism(OrganismHandle organism) {
+    this->addOrganism(organism, this->_serial_context);
+}
+
+/** @brief Add organism to ecosystem from a given context
+*
 * Procedure:
 * 1. add organism to current biotope
 * 2. delete its position from biotope_free_locs
+* 3. mark its position as occupied in biotope_occupancy and changed in biotope_changes
+*
+* Steps on structures shared by all tiles (biotope_free_locs and number of
+* organisms) are just logged in deferred contexts.
 *
-* @param[in] organism Pointer to organism to be added to ecosystem
+* @param[in] organism Handle of organism to be added to ecosystem
+* @param[in] context Context where it happens
 */
-void Ecosystem::addOrganism(Organism* organism) {
-    this->biotope[organism->location] = organism;
-    this->biotope_free_locs.erase(organism->location);
+void Ecosystem::addOrganism(OrganismHandle organism, EvolutionContext& context) {
+    const tuple<int, int>& location = this->organisms.location[organism.index];
+    int index = this->biotope.index(location);
+    this->biotope._place(index, organism);
+    this->biotope_occupancy.set(get<0>(location), get<1>(location));
+    this->biotope_changes.mark(index);
+    if (context.deferred) {
+        context.free_locs_log.push_back(-(index + 1));
+        context.num_organisms_delta += 1;
+    } else {
+        this->biotope_free_locs.erase(index);
+        this->biotope._num_organisms += 1;
+    }
 }
 
 /** @brief Remove organism from ecosystem
 *
+* @param[in] organism Handle of organism to be removed from ecosystem
+*/
+void Ecosystem::removeOrganism(OrganismHandle organism) {
+    this->removeOrganism(organism, this->_serial_context);
+}
+
+/** @brief Remove organism from ecosystem from a given context
+*
 * Procedure:
 * 1. delete organism from current biotope
 * 2. add its position to biotope_free_locs
-* 3. queue organism to be deleted at the end of iteration
+* 3. mark its position as free in biotope_occupancy and changed in biotope_changes
+* 4. retire organism, so its slot is recycled at the end of iteration
 *
-* @param[in] organism Pointer to organism to be removed from ecosystem
+* Steps on structures shared by all tiles (biotope_free_locs, number of
+* organisms and retired organisms) are just logged in deferred contexts.
+*
+* @param[in] organism Handle of organism to be removed from ecosystem
+* @param[in] context Context where it happens
 */
-void Ecosystem::removeOrganism(Organism* organism) {
-    this->biotope.erase(organism->location);
-    this->biotope_free_locs.insert(organism->location);
-    this->_dead_organisms.push_back(organism);
+void Ecosystem::removeOrganism(OrganismHandle organism, EvolutionContext& context) {
+    const tuple<int, int>& location = this->organisms.location[organism.index];
+    int index = this->biotope.index(location);
+    this->biotope._clear(index);
+    this->biotope_occupancy.clear(get<0>(location), get<1>(location));
+    this->biotope_changes.mark(index);
+    if (context.deferred) {
+        context.free_locs_log.push_back(index);
+        context.num_organisms_delta -= 1;
+        context.retired.push_back(organism);
+    } else {
+        this->biotope_free_locs.insert(index);
+        this->biotope._num_organisms -= 1;
+        this->organisms.retire(organism);
+    }
 }
 
 /** @brief Update organism location
 *
+* @param[in] organism Handle of organism that is moving
+*/
+void Ecosystem::updateOrganismLocation(OrganismHandle organism) {
+    this->updateOrganismLocation(organism, this->_serial_context);
+}
+
+/** @brief Update organism location from a given context
+*
 * Organism must call this function when it moves to let Ecosystem know it
 *
 * Procedure:
 * 1. delete organism's old_location from biotope
-* 2. add its old position to biotope_free_locs
+* 2. add its old position to biotope_free_locs and mark it as free
 * 3. add organism to biotope according with its new location
-* 2. delete organism's new location from biotope_free_locs
-* 3. update organisms->old_location with its new location
+* 4. delete organism's new location from biotope_free_locs and mark it as occupied
+*    (both locations are marked as changed in biotope_changes)
+* 5. update organisms->old_location with its new location
+*
+* Changes on biotope_free_locs are just logged in deferred contexts.
 *
-* @param[in] organism Pointer to organism that is moving
+* @param[in] organism Handle of organism that is moving
+* @param[in] context Context where it happens
 */
-void Ecosystem::updateOrganismLocation(Organism* organism){
-    this->biotope.erase(organism->old_location);
-    this->biotope_free_locs.insert(organism->old_location);
-    this->biotope[organism->location] = organism;
-    this->biotope_free_locs.erase(organism->location);
-    organism->old_location = organism->location;
+void Ecosystem::updateOrganismLocation(OrganismHandle organism, EvolutionContext& context) {
+    tuple<int, int>& old_location = this->organisms.old_location[organism.index];
+    const tuple<int, int>& location = this->organisms.location[organism.index];
+    int old_index = this->biotope.index(old_location);
+    int index = this->biotope.index(location);
+    this->biotope._clear(old_index);
+    this->biotope_occupancy.clear(get<0>(old_location), get<1>(old_location));
+    this->biotope._place(index, organism);
+    this->biotope_occupancy.set(get<0>(location), get<1>(location));
+    this->biotope_changes.mark(old_index);
+    this->biotope_changes.mark(index);
+    if (context.deferred) {
+        context.free_locs_log.push_back(old_index);
+        context.free_locs_log.push_back(-(index + 1));
+    } else {
+        this->biotope_free_locs.insert(old_index);
+        this->biotope_free_locs.erase(index);
+    }
+    old_location = location;
 }
 
-/** @brief Get a vector of free positions (random order) around a given center (x, y)
+/** @brief Get one free position, chosen at random, around a given center (x, y)
 *
-* Only positions adjacent to center are reported.
+* No vector is built nor shuffled: the free cells are counted with a
+* popcount and a random one is selected from the neighborhood mask.
 *
-* @param[in] center <x. y> tuple around which free locations are searched
-* @param[out] surrounding_free_locations Vector where surrounding free locations are appended
+* @param[in] center <x. y> tuple around which a free location is searched
+* @param[out] free_location Free location found (untouched if there is none)
+* @param[in] random Random stream used to choose the location
+* @returns false if all surrounding locations are occupied
 */
-void Ecosystem::getSurroundingFreeLocations(tuple<int, int> center, vector<tuple<int, int>> &surrounding_free_locations) {
+bool Ecosystem::getRandomSurroundingFreeLocation(tuple<int, int> center, tuple<int, int> &free_location, RandomStream& random) {
     int center_x = get<0>(center);
     int center_y = get<1>(center);
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if ((dx == 0) && (dy == 0))
-                break;
-            int x = (center_x + dx + this->biotope_size_x) % this->biotope_size_x;
-            int y = (center_y + dy + this->biotope_size_y) % this->biotope_size_y;
-            tuple<int, int> candidate_location = make_tuple(x, y);
-            bool candidate_location_in_biotope_free_locs = (this->biotope_free_locs.find(candidate_location) != this->biotope_free_locs.end());
-            if (candidate_location_in_biotope_free_locs) {
-                surrounding_free_locations.push_back(candidate_location);
-            }
-        }
-    }
-    shuffle(surrounding_free_locations.begin(), surrounding_free_locations.end(), eng);
+    unsigned int free_mask = ~this->biotope_occupancy.neighborhoodMask(center_x, center_y) & NEIGHBORS_MASK;
+    if (free_mask == 0)
+        return false;
+    for (int k = random.uniformInt(0, __builtin_popcount(free_mask) - 1); k > 0; k--)
+        free_mask &= free_mask - 1;  // drop lowest set bit
+    free_location = this->_neighborLocation(center_x, center_y, __builtin_ctz(free_mask));
+    return true;
 }
 
-/** @brief Get a vector of organisms (random order) around a given location (x, y)
+/** @brief Get organisms around a given location (x, y), without shuffling them
 *
-* Only organisms adjacent to center (but not IN center) are reported.
+* Only organisms adjacent to center (but not IN center) are reported, in
+* neighborhood mask order.
 *
-* @param[in] center <x. y> tuple around which free locations are searched
-* @param[out] surrounding_organisms Vector of organisms around center
+* @param[in] center <x. y> tuple around which organisms are searched
+* @param[out] surrounding_organisms Array where organisms around center are stored
+* @returns Number of organisms stored in surrounding_organisms
 */
-void Ecosystem::getSurroundingOrganisms(tuple<int, int> center, vector<Organism*> &surrounding_organisms) {
+int Ecosystem::getSurroundingOrganisms(tuple<int, int> center, OrganismHandle surrounding_organisms[8]) {
     int center_x = get<0>(center);
     int center_y = get<1>(center);
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if ((dx == 0) && (dy == 0))
-                break;
-            int x = (center_x + dx + this->biotope_size_x) % this->biotope_size_x;
-            int y = (center_y + dy + this->biotope_size_y) % this->biotope_size_y;
-            tuple<int, int> candidate_location = make_tuple(x, y);
-            bool organism_is_in_biotope = (this->biotope.find(candidate_location) != this->biotope.end());
-            if (organism_is_in_biotope) {
-                surrounding_organisms.push_back(this->biotope[candidate_location]);
-            }
-        }
+    unsigned int occupied_mask = this->biotope_occupancy.neighborhoodMask(center_x, center_y) & NEIGHBORS_MASK;
+    int num_organisms = 0;
+    while (occupied_mask != 0) {
+        int bit = __builtin_ctz(occupied_mask);
+        occupied_mask &= occupied_mask - 1;
+        surrounding_organisms[num_organisms++] = this->biotope.get(this->_neighborLocation(center_x, center_y, bit));
     }
-    shuffle(surrounding_organisms.begin(), surrounding_organisms.end(), eng);
+    return num_organisms;
 }
 
 /** @brief Evolve one time unit in ecosystem
 *
 * 1. Delete dead organisms
 * 2. For each organism in current biotope, run organism->act()
+*    (serially, or tile by tile in parallel if PARALLEL_SETTINGS say so)
 * 3. Increase ecosystem time in 1 unit
 */
 void Ecosystem::evolve() {
     this->_deleteDeadOrganisms();
+    if (this->_tiles.empty())
+        this->_evolveSerially();
+    else
+        this->_evolveInParallel();
+    this->time += 1;
+}
 
-    // Create a vector of current organisms (needed because biotope is a map)
-    vector<Organism*> organisms_to_act(this->biotope.size(), nullptr);
-    int i = 0;
-    for (auto x:this->biotope) {
-        organisms_to_act[i] = x.second;
-        i += 1;
+/** @brief Make every organism act, one after another
+*/
+void Ecosystem::_evolveSerially() {
+    // Create a vector of current organisms (needed because they move while acting)
+    vector<OrganismHandle> organisms_to_act;
+    organisms_to_act.reserve(this->biotope.size());
+    int num_cells = this->biotope.numCells();
+    for (int i = 0; i < num_cells; i++) {
+        OrganismHandle organism = this->biotope.get(i);
+        if (!organism.isNull())
+            organisms_to_act.push_back(organism);
     }
     // For each organism, act
     for (auto organism:organisms_to_act) {
-        if (organism->is_alive) {;
-            organism->act();
+        if (this->organisms.is_alive[organism.index]) {
+            Organism(this, organism, this->_serial_context).act();
         }
     }
-    this->time += 1;
+}
+
+/** @brief Make every organism act, running tiles of the same color in parallel
+*
+* Procedure:
+* 1. collect organisms of each tile (in row-major order)
+* 2. for each color: make organisms in all tiles of that color act in
+*    parallel, then apply the changes logged by those tiles in tile order
+*
+* Each organism draws from its own random stream, so results only depend on
+* the seed and on the tiles layout, not on the number of threads nor on
+* thread scheduling.
+*/
+void Ecosystem::_evolveInParallel() {
+    // Births can't reallocate columns while organisms act concurrently
+    this->organisms.reserve(this->organisms.capacity() + this->biotope.size());
+
+    int num_tiles = (int)this->_tiles.size();
+    this->_thread_pool->parallelFor(num_tiles, [this](int t) {
+        EvolutionTile& tile = this->_tiles[t];
+        tile.organisms_to_act.clear();
+        for (int y = tile.y_begin; y < tile.y_end; y++) {
+            for (int x = tile.x_begin; x < tile.x_end; x++) {
+                OrganismHandle organism = this->biotope.get(x, y);
+                if (!organism.isNull())
+                    tile.organisms_to_act.push_back(organism);
+            }
+        }
+    });
+
+    for (int color = 0; color < this->_num_tile_phases; color++) {
+        vector<int> tiles_of_color;
+        for (int t = 0; t < num_tiles; t++) {
+            if (this->_tiles[t].color == color)
+                tiles_of_color.push_back(t);
+        }
+        this->_thread_pool->parallelFor((int)tiles_of_color.size(), [this, &tiles_of_color](int k) {
+            EvolutionTile& tile = this->_tiles[tiles_of_color[k]];
+            for (auto organism:tile.organisms_to_act) {
+                if (this->organisms.is_alive[organism.index]) {
+                    Organism(this, organism, tile.context).act();
+                }
+            }
+        });
+        for (int t : tiles_of_color)
+            this->_applyDeferredChanges(this->_tiles[t].context);
+    }
+}
+
+/** @brief Apply (and clear) changes logged by a deferred context
+*
+* @param[in] context Context of a tile which has just evolved
+*/
+void Ecosystem::_applyDeferredChanges(EvolutionContext& context) {
+    for (int change : context.free_locs_log) {
+        if (change >= 0)
+            this->biotope_free_locs.insert(change);
+        else
+            this->biotope_free_locs.erase(-change - 1);
+    }
+    this->biotope._num_organisms += context.num_organisms_delta;
+    for (auto organism : context.retired)
+        this->organisms.retire(organism);
+    context.free_locs_log.clear();
+    context.num_organisms_delta = 0;
+    context.retired.clear();
+}
+
+/** @brief Split biotope in tiles for parallel evolution, according to PARALLEL_SETTINGS
+*
+* Tiles form a grid whose number of columns and rows are multiples of
+* num_tile_colors, and tile (tx, ty) gets color
+* (tx % num_tile_colors) + num_tile_colors * (ty % num_tile_colors).
+* An acting organism may touch cells up to 2 cells away from its initial
+* location (it can move and then hunt or procreate around), so tiles of the
+* same color must be separated by at least 4 cells: tiles get smaller than
+* that, or num_threads is 1, evolution is serial (no tiles).
+*/
+void Ecosystem::_initializeTiles() {
+    const CompiledSettings& settings = this->_compiled_settings;
+    const int MIN_SEPARATION = 4;
+    int k = max(settings.num_tile_colors, 2);
+    int min_tile_size = (MIN_SEPARATION + k - 2) / (k - 1);
+    int tile_size_x = max(settings.tile_size_x, min_tile_size);
+    int tile_size_y = max(settings.tile_size_y, min_tile_size);
+    int num_tiles_x = (this->biotope_size_x / tile_size_x) / k * k;
+    int num_tiles_y = (this->biotope_size_y / tile_size_y) / k * k;
+
+    this->_tiles.clear();
+    this->_num_tile_phases = 0;
+    if ((settings.num_threads <= 1) || (num_tiles_x == 0) || (num_tiles_y == 0)) {
+        this->_thread_pool.reset();
+        return;
+    }
+    this->_num_tile_phases = k * k;
+    this->_tiles.resize(num_tiles_x * num_tiles_y);
+    for (int ty = 0; ty < num_tiles_y; ty++) {
+        for (int tx = 0; tx < num_tiles_x; tx++) {
+            EvolutionTile& tile = this->_tiles[ty * num_tiles_x + tx];
+            tile.x_begin = this->biotope_size_x * tx / num_tiles_x;
+            tile.x_end = this->biotope_size_x * (tx + 1) / num_tiles_x;
+            tile.y_begin = this->biotope_size_y * ty / num_tiles_y;
+            tile.y_end = this->biotope_size_y * (ty + 1) / num_tiles_y;
+            tile.color = (tx % k) + k * (ty % k);
+            tile.context.deferred = true;
+        }
+    }
+    if (!this->_thread_pool || (this->_thread_pool->size() != settings.num_threads))
+        this->_thread_pool.reset(new ThreadPool(settings.num_threads));
+}
+
+/** @brief Initialize random_seed and the ecosystem random stream from settings_json
+*
+* Backups written before the "SEED" state existed only have a serialized
+* engine ("RANDOM_ENG"): their seed is derived from it (FNV-1a hash).
+*/
+void Ecosystem::_initializeRandom() {
+    json& state = this->settings_json["state"];
+    if (state.count("SEED")) {
+        this->random_seed = state["SEED"];
+    } else if (state.count("RANDOM_ENG")) {
+        string str_random = state["RANDOM_ENG"];
+        uint32_t hash = 2166136261u;
+        for (unsigned char c : str_random)
+            hash = (hash ^ c) * 16777619u;
+        this->random_seed = hash;
+    } else {
+        this->random_seed = (random_device())();
+    }
+    state["SEED"] = this->random_seed;
+    this->_random = RandomStream(this->random_seed, (uint32_t)this->time, 0, RANDOM_DOMAIN_INITIALIZATION);
+    this->_serial_context.random = &this->_random;
 }
 
 /** @brief Initialize biotope
 * 
-* Initialize biotope_free_locs with all positions in biotope.
+* Allocate the (empty) biotope grid, occupancy bitmap and set of changed
+* cells, and initialize
+* biotope_free_locs with all positions in biotope.
 */
 void Ecosystem::_initializeBiotope() {
-    for (int x = 0; x < this->biotope_size_x; x++) {
-        for (int y = 0; y < this->biotope_size_y; y++) {
-            this->biotope_free_locs.insert(make_tuple(x, y));
-        }
-    }
+    this->biotope.resize(this->biotope_size_x, this->biotope_size_y);
+    this->biotope_free_locs.resize(this->biotope_size_x, this->biotope_size_y);
+    this->biotope_occupancy.resize(this->biotope_size_x, this->biotope_size_y);
+    this->biotope_changes.resize(this->biotope_size_x * this->biotope_size_y);
+}
+
+/** @brief Get location of a neighbor given its bit in a neighborhood mask
+*
+* @param[in] center_x X coordinate of center
+* @param[in] center_y Y coordinate of center
+* @param[in] bit Bit (dy + 1) * 3 + (dx + 1) of a neighborhood mask
+* @returns Location (center_x + dx, center_y + dy), with toroidal wraparound
+*/
+tuple<int, int> Ecosystem::_neighborLocation(int center_x, int center_y, int bit) {
+    int x = center_x + (bit % 3) - 1;
+    int y = center_y + (bit / 3) - 1;
+    if (x < 0) x += this->biotope_size_x;
+    else if (x >= this->biotope_size_x) x -= this->biotope_size_x;
+    if (y < 0) y += this->biotope_size_y;
+    else if (y >= this->biotope_size_y) y -= this->biotope_size_y;
+    return make_tuple(x, y);
 }
 
 /** @brief Create organisms and add them to ecosystem
@@ -348,14 +1173,20 @@ void Ecosystem::_initializeBiotope() {
 * It is separately done for (1) plants, (2) herbivores and (3) carnivores.
 */
 void Ecosystem::_initializeOrganisms() {
+    const CompiledSettings& settings = this->_compiled_settings;
+    size_t total_number_of_organisms = 0;
+    for (int NUMBER_OF_ORGANISMS : settings.initial_num_of_organisms)
+        total_number_of_organisms += NUMBER_OF_ORGANISMS;
+    this->organisms.reserve(total_number_of_organisms);
+
     // Create and add organisms
-    for (string SPECIES : settings_json["constants"]["SPECIES"])
+    for (int SPECIES = 0; SPECIES < (int)settings.species.size(); SPECIES++)
     {
-        int      NUMBER_OF_ORGANISMS = int(settings_json["constants"]["INITIAL_NUM_OF_ORGANISMS"][SPECIES]);
-        float INITIAL_ENERGY_RESERVE = int(settings_json["constants"]["INITIAL_ENERGY_RESERVE"]);
+        int      NUMBER_OF_ORGANISMS = settings.initial_num_of_organisms[SPECIES];
+        float INITIAL_ENERGY_RESERVE = int(settings.initial_energy_reserve);
         for (int i = 0; i < NUMBER_OF_ORGANISMS; i++) {
             tuple<int, int> rand_location = this->_getRandomFreeLocation();
-            this->addOrganism(new Organism(rand_location, this, SPECIES, INITIAL_ENERGY_RESERVE));
+            this->addOrganism(this->createOrganism(rand_location, SPECIES, INITIAL_ENERGY_RESERVE));
         }
     }
 }
@@ -367,44 +1198,77 @@ void Ecosystem::_initializeOrganisms() {
 void Ecosystem::_initializeOrganisms(json& data_json) {
     if (data_json.find("organisms") != data_json.end()) {
         int num_organisms = data_json["organisms"]["locations"].size();
+        this->organisms.reserve(num_organisms);
         for (int i=0; i < num_organisms; i++) {
             tuple<int, int> location = make_tuple(data_json["organisms"]["locations"][i][0],
                                                   data_json["organisms"]["locations"][i][1]);
-            string species = data_json["organisms"]["species"][i];
+            SpeciesId species = this->_compiled_settings.species.id(data_json["organisms"]["species"][i]);
             float energy_reserve = data_json["organisms"]["energy_reserve"][i];
-            Organism* o = new Organism(location, this, species, energy_reserve);
+            OrganismHandle o = this->createOrganism(location, species, energy_reserve);
             // Set genes and state
-            o->initial_energy_reserve = data_json["organisms"]["initial_energy_reserve"][i];
-            o->age = data_json["organisms"]["age"][i];
-            o->death_age = data_json["organisms"]["death_age"][i];
-            o->is_energy_dependent = data_json["organisms"]["is_energy_dependent"][i];
+            this->organisms.initial_energy_reserve[o.index] = data_json["organisms"]["initial_energy_reserve"][i];
+            this->organisms.age[o.index] = data_json["organisms"]["age"][i];
+            this->organisms.death_age[o.index] = data_json["organisms"]["death_age"][i];
+            this->organisms.is_energy_dependent[o.index] = bool(data_json["organisms"]["is_energy_dependent"][i]);
             this->addOrganism(o);
         }
     }
     else _initializeOrganisms();
 }
 
+/** @brief Initialize organisms from columns (mapped snapshot or capture)
+*
+* @param[in] columns Attributes of living organisms
+*/
+void Ecosystem::_initializeOrganisms(const OrganismColumns& columns) {
+    this->organisms.reserve(columns.size);
+    for (size_t i = 0; i < columns.size; i++) {
+        int x = columns.location_x[i];
+        int y = columns.location_y[i];
+        if ((x < 0) || (x >= this->biotope_size_x) || (y < 0) || (y >= this->biotope_size_y) ||
+            (columns.species[i] >= this->_compiled_settings.species.size()) ||
+            !this->biotope.get(x, y).isNull())
+            throw runtime_error("corrupted snapshot: invalid organism " + to_string(i));
+        OrganismHandle o = this->createOrganism(make_tuple(x, y), columns.species[i], columns.energy_reserve[i]);
+        this->organisms.initial_energy_reserve[o.index] = columns.initial_energy_reserve[i];
+        this->organisms.age[o.index] = columns.age[i];
+        this->organisms.death_age[o.index] = columns.death_age[i];
+        this->organisms.is_energy_dependent[o.index] = (columns.flags[i] & SNAPSHOT_FLAG_ENERGY_DEPENDENT) ? 1 : 0;
+        this->addOrganism(o);
+    }
+}
+
 /** @brief Get random free location in biotope
 * 
-* It just takes a random value from biotope_free_locs set.
+* It just takes a random value from biotope_free_locs, in O(1).
 */
 tuple<int, int> Ecosystem::_getRandomFreeLocation() {
-    uniform_int_distribution<int> distribution(0, this->biotope_free_locs.size() - 1);
-    auto it = this->biotope_free_locs.begin();
-    int r = distribution(eng);
-    advance(it, r);
-    return *it;
+    return this->biotope_free_locs.sample(this->_random);
 }
 
-/** @brief Delete all objects queued in dead_organisms vector
+/** @brief Recycle store slots of all organisms retired in last iteration
 *
 * It is run at the beginning of each iteration
 */
 void Ecosystem::_deleteDeadOrganisms() {
-    for (auto dead_organism:this->_dead_organisms) {
-        delete dead_organism;
-    }
-    this->_dead_organisms.clear();
+    this->organisms.recycle();
+}
+
+/** @brief Copy current state to a capture, to be saved later
+*
+* @param[out] capture Capture where state is copied (previous content is replaced)
+*/
+void Ecosystem::capture(EcosystemCapture& capture) {
+    capture.time = this->time;
+    capture.seed = this->random_seed;
+    capture.constants = settings_json["constants"];
+    capture.species_names = this->_compiled_settings.species.names();
+    capture.organisms.clear();
+    for (auto x:this->biotope)
+        capture.organisms.push_back(this->organisms, x.second.index, false);
+    capture.dead_organisms.clear();
+    for (OrganismHandle organism:this->organisms.retired())
+        capture.dead_organisms.push_back(this->organisms, organism.index, true);
 }
 
 /** @brief Serialize ecosystem to a JSON
@@ -412,39 +1276,427 @@ void Ecosystem::_deleteDeadOrganisms() {
 * @param[out] data_json Variable where data will be stores as a json
 */
 void Ecosystem::serialize(json& data_json) {
+    EcosystemCapture capture;
+    this->capture(capture);
+    capture.serialize(data_json);
+}
+
+/** @brief Write ecosystem to a binary snapshot (see SnapshotHeader)
+*
+* @param[out] out Binary output stream
+*/
+void Ecosystem::writeSnapshot(ostream& out) {
+    EcosystemCapture capture;
+    this->capture(capture);
+    capture.writeSnapshot(out);
+}
+
+
+/*********************************************************
+* EcosystemCapture implementation
+*/
+
+/** @brief Remove all organisms (memory is kept for next capture)
+*/
+void CapturedOrganisms::clear() {
+    this->location_x.clear();
+    this->location_y.clear();
+    this->species.clear();
+    this->age.clear();
+    this->death_age.clear();
+    this->energy_reserve.clear();
+    this->initial_energy_reserve.clear();
+    this->flags.clear();
+    this->cause_of_death.clear();
+}
+
+/** @brief Resize every column but cause_of_death
+*/
+void CapturedOrganisms::resize(size_t size) {
+    this->location_x.resize(size);
+    this->location_y.resize(size);
+    this->species.resize(size);
+    this->age.resize(size);
+    this->death_age.resize(size);
+    this->energy_reserve.resize(size);
+    this->initial_energy_reserve.resize(size);
+    this->flags.resize(size);
+}
+
+/** @brief Overwrite organism k (but cause_of_death) with organism i of some columns
+*/
+void CapturedOrganisms::set(size_t k, const OrganismColumns& columns, size_t i) {
+    this->location_x[k] = columns.location_x[i];
+    this->location_y[k] = columns.location_y[i];
+    this->species[k] = columns.species[i];
+    this->age[k] = columns.age[i];
+    this->death_age[k] = columns.death_age[i];
+    this->energy_reserve[k] = columns.energy_reserve[i];
+    this->initial_energy_reserve[k] = columns.initial_energy_reserve[i];
+    this->flags[k] = columns.flags[i];
+}
+
+/** @brief Append a copy of an organism
+*
+* @param[in] organisms Store where organism lives
+* @param[in] i Slot of organism in store
+* @param[in] with_cause_of_death If true, cause_of_death is copied too
+*/
+void CapturedOrganisms::push_back(const OrganismStore& organisms, uint32_t i, bool with_cause_of_death) {
+    this->location_x.push_back(std::get<0>(organisms.location[i]));
+    this->location_y.push_back(std::get<1>(organisms.location[i]));
+    this->species.push_back(organisms.species[i]);
+    this->age.push_back(organisms.age[i]);
+    this->death_age.push_back(organisms.death_age[i]);
+    this->energy_reserve.push_back(organisms.energy_reserve[i]);
+    this->initial_energy_reserve.push_back(organisms.initial_energy_reserve[i]);
+    this->flags.push_back(organisms.is_energy_dependent[i] ? SNAPSHOT_FLAG_ENERGY_DEPENDENT : 0);
+    if (with_cause_of_death)
+        this->cause_of_death.push_back(organisms.cause_of_death[i]);
+}
+
+/** @brief Point to the columns of a binary snapshot
+*/
+OrganismColumns::OrganismColumns(const SnapshotView& snapshot) {
+    this->size = snapshot.numOrganisms();
+    this->location_x = snapshot.column<int32_t>(SNAPSHOT_LOCATION_X);
+    this->location_y = snapshot.column<int32_t>(SNAPSHOT_LOCATION_Y);
+    this->species = snapshot.column<SpeciesId>(SNAPSHOT_SPECIES);
+    this->age = snapshot.column<int32_t>(SNAPSHOT_AGE);
+    this->death_age = snapshot.column<int32_t>(SNAPSHOT_DEATH_AGE);
+    this->energy_reserve = snapshot.column<float>(SNAPSHOT_ENERGY_RESERVE);
+    this->initial_energy_reserve = snapshot.column<float>(SNAPSHOT_INITIAL_ENERGY_RESERVE);
+    this->flags = snapshot.column<uint8_t>(SNAPSHOT_FLAGS);
+}
+
+/** @brief Point to the columns of organisms added by a delta snapshot
+*/
+OrganismColumns::OrganismColumns(const DeltaView& delta) {
+    this->size = delta.header().num_added;
+    this->location_x = delta.addedColumn<int32_t>(SNAPSHOT_LOCATION_X);
+    this->location_y = delta.addedColumn<int32_t>(SNAPSHOT_LOCATION_Y);
+    this->species = delta.addedColumn<SpeciesId>(SNAPSHOT_SPECIES);
+    this->age = delta.addedColumn<int32_t>(SNAPSHOT_AGE);
+    this->death_age = delta.addedColumn<int32_t>(SNAPSHOT_DEATH_AGE);
+    this->energy_reserve = delta.addedColumn<float>(SNAPSHOT_ENERGY_RESERVE);
+    this->initial_energy_reserve = delta.addedColumn<float>(SNAPSHOT_INITIAL_ENERGY_RESERVE);
+    this->flags = delta.addedColumn<uint8_t>(SNAPSHOT_FLAGS);
+}
+
+/** @brief Point to the columns of captured organisms
+*/
+OrganismColumns::OrganismColumns(const CapturedOrganisms& organisms) {
+    this->size = organisms.size();
+    this->location_x = organisms.location_x.data();
+    this->location_y = organisms.location_y.data();
+    this->species = organisms.species.data();
+    this->age = organisms.age.data();
+    this->death_age = organisms.death_age.data();
+    this->energy_reserve = organisms.energy_reserve.data();
+    this->initial_energy_reserve = organisms.initial_energy_reserve.data();
+    this->flags = organisms.flags.data();
+}
+
+/** @brief Serialize captured ecosystem to a JSON (.zjson backups)
+*
+* @param[out] data_json Variable where data will be stores as a json
+*/
+void EcosystemCapture::serialize(json& data_json) const {
     // ecosystem data
-    data_json["constants"] = settings_json["constants"];
+    data_json["constants"] = this->constants;
     data_json["state"]["time"] = this->time;
-    ostringstream str_random;
-    str_random << eng;
-    data_json["state"]["RANDOM_ENG"] = str_random.str();
+    data_json["state"]["SEED"] = this->seed;
 
     // living organisms data
-    for (auto x:this->biotope) {
-        tuple<int, int> position = x.first;
-        Organism* organism = x.second;
-        data_json["organisms"]["locations"].push_back({get<0>(position), get<1>(position)});
-        data_json["organisms"]["species"].push_back(organism->species);
-        data_json["organisms"]["age"].push_back(organism->age);
-        data_json["organisms"]["death_age"].push_back(organism->death_age);
-        data_json["organisms"]["initial_energy_reserve"].push_back(organism->initial_energy_reserve);
-        data_json["organisms"]["energy_reserve"].push_back(organism->energy_reserve);
-        data_json["organisms"]["is_energy_dependent"].push_back(organism->is_energy_dependent);
+    const CapturedOrganisms& alive = this->organisms;
+    for (size_t i = 0; i < alive.size(); i++) {
+        data_json["organisms"]["locations"].push_back({alive.location_x[i], alive.location_y[i]});
+        data_json["organisms"]["species"].push_back(this->species_names[alive.species[i]]);
+        data_json["organisms"]["age"].push_back(alive.age[i]);
+        data_json["organisms"]["death_age"].push_back(alive.death_age[i]);
+        data_json["organisms"]["initial_energy_reserve"].push_back(alive.initial_energy_reserve[i]);
+        data_json["organisms"]["energy_reserve"].push_back(alive.energy_reserve[i]);
+        data_json["organisms"]["is_energy_dependent"].push_back(bool(alive.flags[i] & SNAPSHOT_FLAG_ENERGY_DEPENDENT));
     }
     // dead organisms data
-    for (Organism* organism:this->_dead_organisms) {
-        tuple<int, int> position = organism->location;
-        data_json["dead_organisms"]["locations"].push_back({get<0>(position), get<1>(position)});
-        data_json["dead_organisms"]["species"].push_back(organism->species);
-        data_json["dead_organisms"]["age"].push_back(organism->age);
-        data_json["dead_organisms"]["death_age"].push_back(organism->death_age);
-        data_json["dead_organisms"]["cause_of_death"].push_back(organism->cause_of_death);
-        data_json["organisms"]["initial_energy_reserve"].push_back(organism->initial_energy_reserve);
-        data_json["organisms"]["energy_reserve"].push_back(organism->energy_reserve);
-        data_json["dead_organisms"]["is_energy_dependent"].push_back(organism->is_energy_dependent);
+    const CapturedOrganisms& dead = this->dead_organisms;
+    for (size_t i = 0; i < dead.size(); i++) {
+        data_json["dead_organisms"]["locations"].push_back({dead.location_x[i], dead.location_y[i]});
+        data_json["dead_organisms"]["species"].push_back(this->species_names[dead.species[i]]);
+        data_json["dead_organisms"]["age"].push_back(dead.age[i]);
+        data_json["dead_organisms"]["death_age"].push_back(dead.death_age[i]);
+        data_json["dead_organisms"]["cause_of_death"].push_back(dead.cause_of_death[i]);
+        data_json["organisms"]["initial_energy_reserve"].push_back(dead.initial_energy_reserve[i]);
+        data_json["organisms"]["energy_reserve"].push_back(dead.energy_reserve[i]);
+        data_json["dead_organisms"]["is_energy_dependent"].push_back(bool(dead.flags[i] & SNAPSHOT_FLAG_ENERGY_DEPENDENT));
     }
 }
 
+/** @brief Write a number as nlohmann::json dumps a number_float
+*/
+static void _writeJsonFloat(ostream& out, double value) {
+    if (fmod(value, 1) == 0) {
+        out << fixed << setprecision(1);
+    } else {
+        out.unsetf(ios_base::floatfield);
+        out << setprecision(numeric_limits<double>::digits10);
+    }
+    out << value;
+}
+
+/** @brief Write the key and the array of values of a JSON object member
+*
+* @param[out] out Output stream
+* @param[in] key Key of the member (without escape sequences)
+* @param[in] num_values Number of values in array
+* @param[in] write_value Function writing the i-th value
+* @param[in,out] is_first_member False if a comma must be written before key
+*/
+static void _writeJsonArray(ostream& out, const char* key, size_t num_values,
+                            const function<void(size_t)>& write_value, bool& is_first_member) {
+    if (!is_first_member)
+        out << ',';
+    is_first_member = false;
+    out << '"' << key << "\":[";
+    for (size_t i = 0; i < num_values; i++) {
+        if (i > 0)
+            out << ',';
+        write_value(i);
+    }
+    out << ']';
+}
+
+/** @brief Write captured ecosystem as JSON text, without building a JSON document
+*
+* Output is the same as dumping the document built by serialize() (keys in
+* alphabetical order), but organisms are written column by column straight
+* to the stream, so memory doesn't grow with the number of organisms.
+*
+* @param[out] out Output stream (e.g. a zlib filtering stream)
+*/
+void EcosystemCapture::writeJson(ostream& out) const {
+    const CapturedOrganisms& alive = this->organisms;
+    const CapturedOrganisms& dead = this->dead_organisms;
+    vector<string> species_names;
+    for (const string& name : this->species_names)
+        species_names.push_back(json(name).dump());
+    unordered_map<string, string> causes_of_death;
+    for (const string& cause : dead.cause_of_death) {
+        if (causes_of_death.find(cause) == causes_of_death.end())
+            causes_of_death[cause] = json(cause).dump();
+    }
+
+    out << "{\"constants\":" << this->constants;
+    if (dead.size() > 0) {
+        bool is_first = true;
+        out << ",\"dead_organisms\":{";
+        _writeJsonArray(out, "age", dead.size(), [&](size_t i) { out << dead.age[i]; }, is_first);
+        _writeJsonArray(out, "cause_of_death", dead.size(), [&](size_t i) { out << causes_of_death[dead.cause_of_death[i]]; }, is_first);
+        _writeJsonArray(out, "death_age", dead.size(), [&](size_t i) { out << dead.death_age[i]; }, is_first);
+        _writeJsonArray(out, "is_energy_dependent", dead.size(), [&](size_t i) {
+            out << ((dead.flags[i] & SNAPSHOT_FLAG_ENERGY_DEPENDENT) ? "true" : "false");
+        }, is_first);
+        _writeJsonArray(out, "locations", dead.size(), [&](size_t i) {
+            out << '[' << dead.location_x[i] << ',' << dead.location_y[i] << ']';
+        }, is_first);
+        _writeJsonArray(out, "species", dead.size(), [&](size_t i) { out << species_names[dead.species[i]]; }, is_first);
+        out << '}';
+    }
+    // As in serialize(), energies of dead organisms follow those of living ones
+    size_t num_energies = alive.size() + dead.size();
+    if (num_energies > 0) {
+        bool is_first = true;
+        auto energy_reserve = [&](size_t i) {
+            _writeJsonFloat(out, (i < alive.size()) ? alive.energy_reserve[i] : dead.energy_reserve[i - alive.size()]);
+        };
+        auto initial_energy_reserve = [&](size_t i) {
+            _writeJsonFloat(out, (i < alive.size()) ? alive.initial_energy_reserve[i] : dead.initial_energy_reserve[i - alive.size()]);
+        };
+        out << ",\"organisms\":{";
+        if (alive.size() > 0) {
+            _writeJsonArray(out, "age", alive.size(), [&](size_t i) { out << alive.age[i]; }, is_first);
+            _writeJsonArray(out, "death_age", alive.size(), [&](size_t i) { out << alive.death_age[i]; }, is_first);
+        }
+        _writeJsonArray(out, "energy_reserve", num_energies, energy_reserve, is_first);
+        _writeJsonArray(out, "initial_energy_reserve", num_energies, initial_energy_reserve, is_first);
+        if (alive.size() > 0) {
+            _writeJsonArray(out, "is_energy_dependent", alive.size(), [&](size_t i) {
+                out << ((alive.flags[i] & SNAPSHOT_FLAG_ENERGY_DEPENDENT) ? "true" : "false");
+            }, is_first);
+            _writeJsonArray(out, "locations", alive.size(), [&](size_t i) {
+                out << '[' << alive.location_x[i] << ',' << alive.location_y[i] << ']';
+            }, is_first);
+            _writeJsonArray(out, "species", alive.size(), [&](size_t i) { out << species_names[alive.species[i]]; }, is_first);
+        }
+        out << '}';
+    }
+    out << ",\"state\":{\"SEED\":" << this->seed << ",\"time\":" << this->time << "}}";
+}
+
+/** @brief Write captured ecosystem to a binary snapshot
+*
+* Only living organisms are saved, column by column (see SnapshotHeader).
+*
+* @param[out] out Binary output stream
+*/
+void EcosystemCapture::writeSnapshot(ostream& out) const {
+    const CapturedOrganisms& alive = this->organisms;
+    SnapshotWriter writer(out, this->time, this->seed, alive.size(), this->constants.dump());
+    writer.writeColumn(SNAPSHOT_LOCATION_X, alive.location_x.data());
+    writer.writeColumn(SNAPSHOT_LOCATION_Y, alive.location_y.data());
+    writer.writeColumn(SNAPSHOT_SPECIES, alive.species.data());
+    writer.writeColumn(SNAPSHOT_AGE, alive.age.data());
+    writer.writeColumn(SNAPSHOT_DEATH_AGE, alive.death_age.data());
+    writer.writeColumn(SNAPSHOT_ENERGY_RESERVE, alive.energy_reserve.data());
+    writer.writeColumn(SNAPSHOT_INITIAL_ENERGY_RESERVE, alive.initial_energy_reserve.data());
+    writer.writeColumn(SNAPSHOT_FLAGS, alive.flags.data());
+}
+
+/** @brief Replace captured state with the one of a binary snapshot
+*
+* @param[in] snapshot Binary snapshot of an ecosystem
+*/
+void EcosystemCapture::readSnapshot(const SnapshotView& snapshot) {
+    this->time = snapshot.header().time;
+    this->seed = snapshot.header().seed;
+    this->constants = json::parse(snapshot.settings());
+    this->species_names = this->constants.at("SPECIES").get<vector<string>>();
+    OrganismColumns columns(snapshot);
+    CapturedOrganisms& alive = this->organisms;
+    alive.clear();
+    alive.location_x.assign(columns.location_x, columns.location_x + columns.size);
+    alive.location_y.assign(columns.location_y, columns.location_y + columns.size);
+    alive.species.assign(columns.species, columns.species + columns.size);
+    alive.age.assign(columns.age, columns.age + columns.size);
+    alive.death_age.assign(columns.death_age, columns.death_age + columns.size);
+    alive.energy_reserve.assign(columns.energy_reserve, columns.energy_reserve + columns.size);
+    alive.initial_energy_reserve.assign(columns.initial_energy_reserve, columns.initial_energy_reserve + columns.size);
+    alive.flags.assign(columns.flags, columns.flags + columns.size);
+    this->dead_organisms.clear();
+}
+
+/** @brief Compare location of organism i in a with location of organism j in b, in biotope order
+*
+* @returns Negative, zero or positive if location in a is before, equal or after location in b
+*/
+static int _compareLocations(const OrganismColumns& a, size_t i, const OrganismColumns& b, size_t j) {
+    if (a.location_y[i] != b.location_y[j])
+        return (a.location_y[i] < b.location_y[j]) ? -1 : 1;
+    if (a.location_x[i] != b.location_x[j])
+        return (a.location_x[i] < b.location_x[j]) ? -1 : 1;
+    return 0;
+}
+
+/** @brief Write captured ecosystem as a delta snapshot relative to a previous capture (see DeltaHeader)
+*
+* An organism is kept if base has, in the same location, an organism with
+* the same genes and the expected age: it is assumed to be the same one.
+* Otherwise, organisms are removed from base or added.
+*
+* @param[out] out Binary output stream
+* @param[in] base Capture of the previous checkpoint
+*/
+void EcosystemCapture::writeDelta(ostream& out, const EcosystemCapture& base) const {
+    OrganismColumns old_alive(base.organisms);
+    OrganismColumns alive(this->organisms);
+    int elapsed_time = this->time - base.time;
+    vector<uint32_t> removed;
+    vector<float> kept_energy_reserve;
+    vector<uint32_t> added;
+    size_t i = 0, j = 0;
+    while ((i < old_alive.size) || (j < alive.size)) {
+        int order;
+        if (i == old_alive.size) order = 1;
+        else if (j == alive.size) order = -1;
+        else order = _compareLocations(old_alive, i, alive, j);
+        if (order < 0) {
+            removed.push_back((uint32_t)i++);
+        } else if (order > 0) {
+            added.push_back((uint32_t)j++);
+        } else {
+            if ((old_alive.species[i] == alive.species[j]) &&
+                (old_alive.death_age[i] == alive.death_age[j]) &&
+                (old_alive.initial_energy_reserve[i] == alive.initial_energy_reserve[j]) &&
+                (old_alive.flags[i] == alive.flags[j]) &&
+                (old_alive.age[i] + elapsed_time == alive.age[j])) {
+                kept_energy_reserve.push_back(alive.energy_reserve[j]);
+            } else {
+                removed.push_back((uint32_t)i);
+                added.push_back((uint32_t)j);
+            }
+            i++;
+            j++;
+        }
+    }
+    CapturedOrganisms added_organisms;
+    added_organisms.resize(added.size());
+    for (size_t k = 0; k < added.size(); k++)
+        added_organisms.set(k, alive, added[k]);
+
+    DeltaWriter writer(out, this->time, base.time, this->seed, removed.size(), kept_energy_reserve.size(), added.size());
+    writer.writeRemoved(removed.data());
+    writer.writeKeptEnergyReserve(kept_energy_reserve.data());
+    writer.writeAddedColumn(SNAPSHOT_LOCATION_X, added_organisms.location_x.data());
+    writer.writeAddedColumn(SNAPSHOT_LOCATION_Y, added_organisms.location_y.data());
+    writer.writeAddedColumn(SNAPSHOT_SPECIES, added_organisms.species.data());
+    writer.writeAddedColumn(SNAPSHOT_AGE, added_organisms.age.data());
+    writer.writeAddedColumn(SNAPSHOT_DEATH_AGE, added_organisms.death_age.data());
+    writer.writeAddedColumn(SNAPSHOT_ENERGY_RESERVE, added_organisms.energy_reserve.data());
+    writer.writeAddedColumn(SNAPSHOT_INITIAL_ENERGY_RESERVE, added_organisms.initial_energy_reserve.data());
+    writer.writeAddedColumn(SNAPSHOT_FLAGS, added_organisms.flags.data());
+}
+
+/** @brief Move captured state forward by applying a delta snapshot
+*
+* The capture must hold the state at delta.header().base_time. Dead
+* organisms are not stored in deltas, so they are cleared.
+*
+* @param[in] delta Delta snapshot relative to this capture
+*/
+void EcosystemCapture::applyDelta(const DeltaView& delta) {
+    const DeltaHeader& header = delta.header();
+    OrganismColumns old_alive(this->organisms);
+    if ((header.base_time != this->time) || (header.num_removed + header.num_kept != old_alive.size))
+        throw runtime_error("delta snapshot " + to_string(header.time) + " doesn't apply to time " + to_string(this->time));
+    int elapsed_time = header.time - header.base_time;
+
+    // Kept organisms: base list without removed positions, with new age and energy
+    CapturedOrganisms kept;
+    kept.resize(header.num_kept);
+    const uint32_t* removed = delta.removed();
+    const float* kept_energy_reserve = delta.keptEnergyReserve();
+    size_t r = 0, k = 0;
+    for (size_t i = 0; i < old_alive.size; i++) {
+        if ((r < header.num_removed) && (removed[r] == i)) {
+            r++;
+            continue;
+        }
+        if (k == header.num_kept)
+            throw runtime_error("corrupted delta snapshot " + to_string(header.time));
+        kept.set(k, old_alive, i);
+        kept.age[k] += elapsed_time;
+        kept.energy_reserve[k] = kept_energy_reserve[k];
+        k++;
+    }
+
+    // Merge kept and added organisms in biotope order
+    OrganismColumns kept_columns(kept);
+    OrganismColumns added_columns(delta);
+    CapturedOrganisms merged;
+    merged.resize(header.num_kept + header.num_added);
+    size_t i = 0, j = 0;
+    for (size_t m = 0; m < merged.size(); m++) {
+        if ((j == header.num_added) || ((i < header.num_kept) && (_compareLocations(kept_columns, i, added_columns, j) < 0)))
+            merged.set(m, kept_columns, i++);
+        else
+            merged.set(m, added_columns, j++);
+    }
+    swap(this->organisms, merged);
+    this->dead_organisms.clear();
+    this->time = header.time;
+    this->seed = header.seed;
+}
+
 
 /*********************************************************
 * Organism implementation
@@ -453,51 +1705,51 @@ void Ecosystem::serialize(json& data_json) {
 
 /** @brief Organism constructor
 *
-* @param[in] location Location of organism
 * @param[in] parent_ecosystem Pointer to parent ecosystem
-* @param[in] species Species identifier
-* @param[in] energy_reserve Amount of initial energy
+* @param[in] handle Handle of organism in parent_ecosystem->organisms
+* @param[in] context Context where organism acts
 */
-Organism::Organism(tuple<int, int> location, Ecosystem* parent_ecosystem, string& species, float energy_reserve) {
-
-    // Relative to parent_ecosystem:
+Organism::Organism(Ecosystem* parent_ecosystem, OrganismHandle handle, EvolutionContext& context) {
+    this->_context = &context;
+    this->handle = handle;
     this->_parent_ecosystem = parent_ecosystem;
-    this->location = location;
-    this->old_location = location;
-
-    // Genes:
-    this->species = species;
-    this->photosynthesis_capacity = float(parent_ecosystem->settings_json["constants"]["PHOTOSYNTHESIS_CAPACITY"][species]);
-    auto death_age_definition = parent_ecosystem->settings_json["constants"]["DEATH_AGE"][species].get<vector<string>>();
-    this->death_age = (int)evaluateRandomFunction(death_age_definition);
-
-    // State:
-    this->energy_reserve = energy_reserve;
-    this->initial_energy_reserve = energy_reserve;
-    this->is_alive = true;
-    this->age = 0;
-    this->cause_of_death = "";
-    this->is_energy_dependent = true;
+    this->_store = &parent_ecosystem->organisms;
+    this->_settings = &parent_ecosystem->getCompiledSettings();
+    this->_i = handle.index;
 }
 
 
 /** @brief Act
 *
+* Draws come from the stream (seed, time, cell where the organism starts
+* acting), which no other organism uses in this iteration.
 */
 void Organism::act() {
+    RandomStream random(this->_parent_ecosystem->random_seed, (uint32_t)this->_parent_ecosystem->time,
+                        (uint32_t)this->_parent_ecosystem->biotope.index(this->_store->location[_i]),
+                        RANDOM_DOMAIN_ORGANISM);
+    RandomStream* previous_random = this->_context->random;
+    this->_context->random = &random;
+    this->_act();
+    this->_context->random = previous_random;
+}
+
+/** @brief Do every action of an iteration, drawing from _context->random
+*/
+void Organism::_act() {
 
     this->_do_photosynthesis();
 
     this->_do_move();
-    if (!this->is_alive)  // can die while moving
+    if (!this->_store->is_alive[_i])  // can die while moving
         return;
 
     this->_do_hunt();
-    if (!this->is_alive)  // can die while hunting
+    if (!this->_store->is_alive[_i])  // can die while hunting
         return;
 
     this->_do_procreate();
-    if (!this->is_alive)  // can die while procreating
+    if (!this->_store->is_alive[_i])  // can die while procreating
         return;
 
     this->_do_age();
@@ -508,19 +1760,18 @@ void Organism::act() {
 * It just increases energy_reserve a constant value equals to photosynthesis_capacity
 */
 void Organism::_do_photosynthesis() {
-    if (this->is_energy_dependent)
-        this->energy_reserve = this->energy_reserve + this->photosynthesis_capacity;
+    if (this->_store->is_energy_dependent[_i])
+        this->_store->energy_reserve[_i] += this->_store->photosynthesis_capacity[_i];
 }
 
 /** @brief true if organism has enough energy to perform a given action
 *
 * It is defined by constant MINIMUM_ENERGY_REQUIRED_TO, which is different than ENERGY_COST
 *
-* @param[in] action Action to be performed (e.g. "move", "hunt", ...)
+* @param[in] action Action to be performed (e.g. ACTION_MOVE, ACTION_HUNT, ...)
 */
-bool Organism::_has_enough_energy_to(const string &action) {
-    float MINIMUM_ENERGY_REQUIRED = float(_parent_ecosystem->settings_json["constants"]["MINIMUM_ENERGY_REQUIRED_TO"][action]);
-    return energy_reserve > MINIMUM_ENERGY_REQUIRED;
+bool Organism::_has_enough_energy_to(OrganismAction action) {
+    return this->_store->energy_reserve[_i] > this->_settings->minimum_energy_required_to[action];
 }
 
 
@@ -530,8 +1781,8 @@ bool Organism::_has_enough_energy_to(const string &action) {
 * @param[in] amount_of_energy Amount of energy to substract from energy_reserve
 */
 void Organism::_do_spend_energy(float amount_of_energy) {
-    this->energy_reserve = this->energy_reserve - amount_of_energy;
-    if (this->energy_reserve <= 0) {
+    this->_store->energy_reserve[_i] -= amount_of_energy;
+    if (this->_store->energy_reserve[_i] <= 0) {
         this->_do_die("starvation");
     }
 }
@@ -540,56 +1791,56 @@ void Organism::_do_spend_energy(float amount_of_energy) {
 *
 * Procedure:
 * 1. spend energy for having the capability of moving
-* 2. if it is still alive: get surrounding free locations around organism's location
-* if there are free locations:
+* 2. if it is still alive: get a random free location around organism's location
+* if there is a free location:
 * 3. spend energy for moving
 * 4. if it is still alive: update organism's location
-* 5. notify ecosystem through ecosystem->updateOrganismLocation(this)
+* 5. notify ecosystem through ecosystem->updateOrganismLocation(handle)
 */
 void Organism::_do_move() {
-    if ((this->species==PLANT) || (this->species==CARNIVORE3))
+    if (!this->_settings->can_move[this->_store->species[_i]])
         return;
 
+    bool is_energy_dependent = this->_store->is_energy_dependent[_i];
     // If it is energy dependent
     if (is_energy_dependent) {
-        if (this->_has_enough_energy_to("move")) {
-            this->_do_spend_energy(
-                _parent_ecosystem->settings_json["constants"]["ENERGY_COST"]["to have the capability of moving"]);
+        if (this->_has_enough_energy_to(ACTION_MOVE)) {
+            this->_do_spend_energy(this->_settings->energy_cost_of_capability_to[ACTION_MOVE]);
         }
-        if (!this->is_alive)
+        if (!this->_store->is_alive[_i])
             return;
     }
     
-    vector<tuple<int, int>> surrounding_free_locations;
-    this->_parent_ecosystem->getSurroundingFreeLocations(this->location, surrounding_free_locations);
-    if (surrounding_free_locations.size() > 0) {
-        if (this->is_energy_dependent) {
-            this->_do_spend_energy(_parent_ecosystem->settings_json["constants"]["ENERGY_COST"]["to move"]);
-            if (!this->is_alive)
+    tuple<int, int> new_location;
+    if (this->_parent_ecosystem->getRandomSurroundingFreeLocation(this->_store->location[_i], new_location, *this->_context->random)) {
+        if (is_energy_dependent) {
+            this->_do_spend_energy(this->_settings->energy_cost_to[ACTION_MOVE]);
+            if (!this->_store->is_alive[_i])
                 return;
         }
-        tuple<int, int> new_location = surrounding_free_locations[0];
-        this->location = new_location;
-        this->_parent_ecosystem->updateOrganismLocation(this);
+        this->_store->location[_i] = new_location;
+        this->_parent_ecosystem->updateOrganismLocation(this->handle, *this->_context);
     }
 }
 
 /** @brief true if a given prey is eatable by this organism
 *
-* @param[in] prey Pointer to prey to be eaten
+* It is defined by the FOOD_WEB in parent ecosystem settings.
+*
+* @param[in] prey Handle of prey to be eaten
 */
-bool Organism::_is_eatable(Organism* prey) {
-    vector<string> food_web = default_settings["constants"]["FOOD_WEB"][this->species];
-    // Check if prey->species in list of species this organism can eat
-    return (find(food_web.begin(), food_web.end(), prey->species) != food_web.end());
+bool Organism::_is_eatable(OrganismHandle prey) {
+    return this->_settings->prey_mask[this->_store->species[_i]].test(this->_store->species[prey.index]);
 }
 
 /** @brief Do hunt
 *
 * Procedure:
 * 1. spend energy for having the capability of hunting
-* 2. if it is still alive: get surrounding free organisms around organism's location
-* 3. for each surrounding organism (now potential prey):
+* 2. if it is still alive: get surrounding organisms around organism's location
+* 3. if none of their species is eatable (checked at once with the food web
+*    bit matrix), stop
+* 4. for each surrounding organism (now potential prey):
 *     * check if prey is eatable
 *     * sum prey's energy reserve to self one
 *     * kill prey
@@ -597,25 +1848,31 @@ bool Organism::_is_eatable(Organism* prey) {
 * @todo Check if all surrounding organisms must be eaten
 */
 void Organism::_do_hunt() {
-    if (this->species == PLANT)
+    if (!this->_settings->can_hunt[this->_store->species[_i]])
         return;  // plants don't hunt
     
-    if (this->is_energy_dependent) {
-        if (this->_has_enough_energy_to("hunt")) {
-            this->_do_spend_energy(
-                _parent_ecosystem->settings_json["constants"]["ENERGY_COST"]["to have the capability of hunting"]);
+    if (this->_store->is_energy_dependent[_i]) {
+        if (this->_has_enough_energy_to(ACTION_HUNT)) {
+            this->_do_spend_energy(this->_settings->energy_cost_of_capability_to[ACTION_HUNT]);
         }
-        if (!this->is_alive)
+        if (!this->_store->is_alive[_i])
             return;
     }
     
-    vector<Organism*> surrounding_organisms;
-    this->_parent_ecosystem->getSurroundingOrganisms(this->location, surrounding_organisms);
-    for (auto surr_organism:surrounding_organisms) {
+    OrganismHandle surrounding_organisms[8];
+    int num_surrounding_organisms = this->_parent_ecosystem->getSurroundingOrganisms(this->_store->location[_i], surrounding_organisms);
+    SpeciesMask surrounding_species;
+    for (int k = 0; k < num_surrounding_organisms; k++)
+        surrounding_species.set(this->_store->species[surrounding_organisms[k].index]);
+    if ((surrounding_species & this->_settings->prey_mask[this->_store->species[_i]]).none())
+        return;  // nothing to eat
+
+    for (int k = 0; k < num_surrounding_organisms; k++) {
+        OrganismHandle surr_organism = surrounding_organisms[k];
         if (this->_is_eatable(surr_organism)) {
-            Organism* prey = surr_organism;
-            this->energy_reserve = this->energy_reserve + prey->energy_reserve;
-            prey->_do_die("hunted");
+            OrganismHandle prey = surr_organism;
+            this->_store->energy_reserve[_i] += this->_store->energy_reserve[prey.index];
+            Organism(this->_parent_ecosystem, prey, *this->_context)._do_die("hunted");
         }
     }
 }
@@ -626,46 +1883,43 @@ void Organism::_do_hunt() {
 * 1. spend energy for having the capability of procreating
 * 2. determine if it procreates according to PROCREATION_PROBABILITY
 * if so: 
-* 3. get surrounding free locations
-* if there are free locations:
+* 3. get a random surrounding free location
+* if there is a free location:
 * 4. define baby's energy reserve (half of self energy_reserve)
 * 5. substract baby's energy reserve from self energy reserve
-* 6. create Organism* baby and add it to ecosystem
+* 6. create baby and add it to ecosystem
 * 7. spend energy for procreating
 */
 void Organism::_do_procreate() {
-    if (this->is_energy_dependent) {
-        if (this->_has_enough_energy_to("procreate"))
-            this->_do_spend_energy(
-                _parent_ecosystem->settings_json["constants"]["ENERGY_COST"]["to have the capability of procreating"]);
-        if (!this->is_alive)
+    if (this->_store->is_energy_dependent[_i]) {
+        if (this->_has_enough_energy_to(ACTION_PROCREATE))
+            this->_do_spend_energy(this->_settings->energy_cost_of_capability_to[ACTION_PROCREATE]);
+        if (!this->_store->is_alive[_i])
             return;  // may have died because of starvation
     }
-    uniform_real_distribution<float> fdis(0, 1.0);
-    float random_value = fdis(eng);
-    float PROCREATION_PROBABILITY = float(_parent_ecosystem->settings_json["constants"]["PROCREATION_PROBABILITY"][species]);
+    float random_value = this->_context->random->uniform01();
+    SpeciesId species = this->_store->species[_i];
+    float PROCREATION_PROBABILITY = this->_settings->procreation_probability[species];
     if (random_value >= PROCREATION_PROBABILITY)  // do not procreate
         return;
     
-    vector<tuple<int, int>> free_locs;
-    this->_parent_ecosystem->getSurroundingFreeLocations(this->location, free_locs);
-    if (free_locs.size() == 0)
+    tuple<int, int> baby_location;
+    if (!this->_parent_ecosystem->getRandomSurroundingFreeLocation(this->_store->location[_i], baby_location, *this->_context->random))
         return;
     
-    tuple<int, int> baby_location = free_locs[0];
-    float baby_energy_reserve = this->energy_reserve / 2.0f;
-    this->energy_reserve = this->energy_reserve - baby_energy_reserve;
-    Organism* baby = new Organism(baby_location, this->_parent_ecosystem, this->species, baby_energy_reserve);
-    this->_parent_ecosystem->addOrganism(baby);
-    if (this->is_energy_dependent)
-        this->_do_spend_energy(_parent_ecosystem->settings_json["constants"]["ENERGY_COST"]["to procreate"]);
+    float baby_energy_reserve = this->_store->energy_reserve[_i] / 2.0f;
+    this->_store->energy_reserve[_i] -= baby_energy_reserve;
+    OrganismHandle baby = this->_parent_ecosystem->createOrganism(baby_location, species, baby_energy_reserve, *this->_context);
+    this->_parent_ecosystem->addOrganism(baby, *this->_context);
+    if (this->_store->is_energy_dependent[_i])
+        this->_do_spend_energy(this->_settings->energy_cost_to[ACTION_PROCREATE]);
 }
 
 /** @brief Increase age 1 unit
 */
 void Organism::_do_age() {
-    this->age += 1;
-    if (this->age > this->death_age)
+    this->_store->age[_i] += 1;
+    if (this->_store->age[_i] > this->_store->death_age[_i])
         this->_do_die("age");
 }
 
@@ -676,7 +1930,7 @@ void Organism::_do_age() {
 * @param[in] cause_of_death Just for debug, indicates why did it die.
 */
 void Organism::_do_die(const string &cause_of_death) {
-    this->is_alive = false;
-    this->cause_of_death = cause_of_death;
-    this->_parent_ecosystem->removeOrganism(this);
+    this->_store->is_alive[_i] = 0;
+    this->_store->cause_of_death[_i] = cause_of_death;
+    this->_parent_ecosystem->removeOrganism(this->handle, *this->_context);
 }
@@ -20,11 +20,20 @@
 #include <set>
 #include <chrono>
 #include <random>
+#include <bitset>
+#include <cstdint>
 #include <unordered_set>
 #include <unordered_map>
 #include <sstream>
+#include <stdexcept>
+#include <memory>
+#include <atomic>
+#include <mutex>
 #include <boost/filesystem.hpp>
 #include "json.hpp"
+#include "ThreadPool.h"
+#include "RandomStream.h"
+#include "Snapshot.h"
 
 namespace fs = boost::filesystem;
 using namespace std;
@@ -51,6 +60,558 @@ extern float _INITIAL_ENERGY_RESERVE;
 //************ HEADERS
 
 class Organism;
+struct OrganismColumns;
+
+/** @brief Actions of an organism having an energy cost
+*/
+enum OrganismAction {
+    ACTION_MOVE = 0,
+    ACTION_HUNT,
+    ACTION_PROCREATE,
+    NUM_ORGANISM_ACTIONS
+};
+
+/** @brief Formats of backups (bit flags), set by constant BACKUP_FORMAT
+*/
+enum BackupFormat {
+    BACKUP_ZJSON = 1,   // compressed JSON (.zjson), read by the web-app
+    BACKUP_BINARY = 2   // binary columnar snapshot (.ecobin)
+};
+
+/** @brief Where frames are drawn, set by constant DRAWING_FORMAT
+*/
+enum DrawingFormat {
+    DRAWING_TGA = 0,     // one .tga file per frame
+    DRAWING_ARCHIVE = 1, // frames appended to a single frame archive
+    DRAWING_Y4M = 2,     // frames streamed as YUV4MPEG2 video (see DRAWING_STREAM)
+    DRAWING_RGB = 3      // frames streamed as raw rgb24 video (see DRAWING_STREAM)
+};
+
+/** @brief Random function parsed from its definition, e.g. {"uniform_int", "0", "30"}
+* @ingroup core
+*/
+struct RandomFunction {
+    enum Distribution { UNKNOWN, UNIFORM_INT };
+    Distribution distribution;
+    int min_value;
+    int max_value;
+    RandomFunction() : distribution(UNKNOWN), min_value(0), max_value(0) {}
+    RandomFunction(const vector<string>& definition);
+    float evaluate(RandomStream& random) const;
+};
+
+/** @brief Small integer identifier of a species
+*/
+typedef uint8_t SpeciesId;
+
+/** @brief Registry mapping species names to dense SpeciesId values
+*
+* IDs are assigned following the order of constant SPECIES. Engine code only
+* stores and compares IDs: names are just used when serializing or drawing.
+* @ingroup core
+*/
+class SpeciesRegistry {
+public:
+    static const int MAX_SPECIES = 256;
+    SpeciesRegistry() {}
+    SpeciesRegistry(const vector<string>& names);
+    SpeciesId id(const string& name) const { return this->_ids.at(name); }
+    bool contains(const string& name) const { return this->_ids.count(name) > 0; }
+    const string& name(SpeciesId id) const { return this->_names[id]; }
+    const vector<string>& names() const { return this->_names; }
+    size_t size() const { return this->_names.size(); }
+private:
+    vector<string> _names;
+    unordered_map<string, SpeciesId> _ids;
+};
+
+/** @brief Set of species, one bit per SpeciesId
+*/
+typedef bitset<SpeciesRegistry::MAX_SPECIES> SpeciesMask;
+
+/** @brief Typed copy of the constants in Ecosystem::settings_json
+*
+* It is built once from settings_json, so organisms don't need any JSON
+* lookup (nor any string to float conversion) while acting. Settings
+* depending on species are stored in vectors indexed by SpeciesId.
+* @ingroup core
+*/
+struct CompiledSettings {
+    /** @brief Species IDs, assigned in the same order as constant SPECIES
+    */
+    SpeciesRegistry species;
+
+    /** @brief ENERGY_COST "to have the capability of <action>"
+    */
+    float energy_cost_of_capability_to[NUM_ORGANISM_ACTIONS];
+
+    /** @brief ENERGY_COST "to <action>"
+    */
+    float energy_cost_to[NUM_ORGANISM_ACTIONS];
+
+    /** @brief MINIMUM_ENERGY_REQUIRED_TO <action>
+    */
+    float minimum_energy_required_to[NUM_ORGANISM_ACTIONS];
+
+    // Settings by species
+    vector<uint8_t> can_move;
+    vector<uint8_t> can_hunt;
+    vector<float> photosynthesis_capacity;
+    vector<float> procreation_probability;
+    vector<RandomFunction> death_age;
+    vector<int> initial_num_of_organisms;
+
+    /** @brief FOOD_WEB: set of species each species can eat
+    */
+    vector<SpeciesMask> prey_mask;
+
+    float initial_energy_reserve;
+    /** @brief PARALLEL_SETTINGS: number of threads (1 for serial evolution)
+    */
+    int num_threads;
+    /** @brief PARALLEL_SETTINGS: minimum size of tiles evolving in parallel
+    */
+    int tile_size_x;
+    int tile_size_y;
+    /** @brief PARALLEL_SETTINGS: tiles are colored in a num_tile_colors^2 checkerboard
+    */
+    int num_tile_colors;
+
+    int backup_period;
+    /** @brief BACKUP_FORMAT ("zjson", "binary" or "both") as BackupFormat flags
+    */
+    unsigned int backup_formats;
+    /** @brief BACKUP_KEYFRAME_PERIOD: binary backups between two full ones are deltas
+    */
+    int backup_keyframe_period;
+    /** @brief BACKUP_COMPRESSION: zlib level of binary backups (0 for uncompressed)
+    */
+    int backup_compression_level;
+    /** @brief BACKUP_COMPRESSION: binary backups are compressed in independent blocks of this size
+    */
+    int backup_block_size;
+    /** @brief BACKUP_COMPRESSION: number of threads compressing blocks
+    */
+    int backup_compression_threads;
+    int drawing_period;
+    int drawing_zoom_factor;
+    /** @brief DRAWING_FORMAT ("tga", "archive", "y4m" or "rgb") as DrawingFormat
+    */
+    int drawing_format;
+    /** @brief DRAWING_STREAM: named pipe, file or "-" (stdout) where video is streamed
+    */
+    string drawing_stream_path;
+    /** @brief DRAWING_STREAM: frame rate of streamed video
+    */
+    int drawing_stream_fps;
+    /** @brief DRAWING_QUEUE: frames waiting to be rendered in background
+    */
+    int drawing_queue_capacity;
+    /** @brief DRAWING_QUEUE: policy "drop" (true) or "block" (false) when the queue is full
+    */
+    bool drawing_drop_frames;
+    /** @brief DRAWING_INCREMENTAL: repaint only the cells whose colour changed since last frame
+    */
+    bool drawing_incremental;
+    /** @brief DRAWING_ENCODER_THREADS: threads run-length encoding each .tga frame
+    */
+    int drawing_encoder_threads;
+
+    CompiledSettings() {}
+    CompiledSettings(const json& settings_json);
+};
+
+/** @brief Generation-checked reference to an organism stored in OrganismStore
+*
+* index is the slot of the organism in every column of the store, and
+* generation must match the generation of that slot: once the organism is
+* destroyed and its slot reused, old handles are no longer valid.
+* @ingroup core
+*/
+struct OrganismHandle {
+    static const uint32_t NULL_INDEX = 0xFFFFFFFF;
+    uint32_t index;
+    uint32_t generation;
+    OrganismHandle() : index(NULL_INDEX), generation(0) {}
+    OrganismHandle(uint32_t index, uint32_t generation) : index(index), generation(generation) {}
+    bool isNull() const { return index == NULL_INDEX; }
+    bool operator==(const OrganismHandle& other) const { return (index == other.index) && (generation == other.generation); }
+    bool operator!=(const OrganismHandle& other) const { return !(*this == other); }
+};
+
+/** @brief Occupancy statistics of an OrganismStore
+* @ingroup core
+*/
+struct OrganismPoolStats {
+    /** @brief Number of slots allocated in every column
+    */
+    size_t capacity;
+    /** @brief Slots holding living organisms
+    */
+    size_t live;
+    /** @brief Slots of organisms dead in current iteration (freed at next one)
+    */
+    size_t retired;
+    /** @brief Slots ready to be reused
+    */
+    size_t free;
+    /** @brief Maximum number of living organisms ever seen
+    */
+    size_t max_live;
+};
+
+/** @brief Structure-of-arrays storage of all organisms
+*
+* Every attribute of the organisms is kept in its own contiguous column
+* (all columns have the same length), so passes touching a few attributes
+* stream through memory linearly.
+*
+* The store works as a pool: dead organisms are retired (their data is kept
+* until the end of the iteration) and their slots are recycled at the next
+* iteration boundary, being reused by new organisms before the columns grow.
+* @ingroup core
+*/
+class OrganismStore {
+public:
+    // Hot columns (read or written by every organism in every iteration)
+    /** @brief Energy reserve of the organism.
+    *
+    * If the energy reserve reaches 0, the organism dies because of starvation.
+    */
+    vector<float> energy_reserve;
+
+    /** @brief Age of organism
+    */
+    vector<int> age;
+
+    /** @brief Death age
+    */
+    vector<int> death_age;
+
+    /** @brief Current location of organism
+    */
+    vector<tuple<int, int>> location;
+
+    /** @brief True if organism is still alive
+    */
+    vector<uint8_t> is_alive;
+
+    /** @brief true if energy matters (typically YES)
+    */
+    vector<uint8_t> is_energy_dependent;
+
+    /** @brief Photosynthesis capacity
+    */
+    vector<float> photosynthesis_capacity;
+
+    // Cold columns
+    /** @brief Initial energy reserve of the organism.
+    */
+    vector<float> initial_energy_reserve;
+
+    /** @brief Old location of organism (before moving)
+    */
+    vector<tuple<int, int>> old_location;
+
+    /** @brief Species of this organism: PLANT, HERBIVORE or CARNIVORE
+    *
+    * Names can be got through the SpeciesRegistry in CompiledSettings.
+    */
+    vector<SpeciesId> species;
+
+    /** @brief Cause of death (in case it is dead)
+    */
+    vector<string> cause_of_death;
+
+    /** @brief Generation of each slot, increased every time it is freed
+    */
+    vector<uint32_t> generation;
+
+    // Public methods (documentation in ecosystem.cpp)
+    OrganismHandle create();
+    void destroy(OrganismHandle handle);
+    void retire(OrganismHandle handle);
+    void recycle();
+    void reserve(size_t capacity);
+    const vector<OrganismHandle>& retired() const { return this->_retired; }
+    OrganismPoolStats stats() const;
+    bool isValid(OrganismHandle handle) const {
+        return (handle.index < this->generation.size()) && (this->generation[handle.index] == handle.generation);
+    }
+    OrganismHandle handle(uint32_t index) const { return OrganismHandle(index, this->generation[index]); }
+    size_t size() const { return this->generation.size() - this->_free_slots.size(); }
+    size_t capacity() const { return this->generation.size(); }
+    void clear();
+    OrganismStore();
+private:
+    /** @brief Slots of destroyed organisms, ready to be reused
+    */
+    vector<uint32_t> _free_slots;
+
+    /** @brief Organisms dead in current iteration, to be recycled
+    */
+    vector<OrganismHandle> _retired;
+
+    /** @brief Maximum number of living organisms (size() - retired) ever seen
+    */
+    size_t _max_live;
+};
+
+/** @brief Dense grid storing which organism occupies each cell of the biotope
+*
+* Cells are stored in row-major order (index = y * size_x + x), so any cell
+* lookup is a single array access. Iterating over it visits only occupied
+* cells and yields (location, organism handle) pairs, like the std::map it
+* replaces.
+* It is read-only for everybody but Ecosystem.
+* @ingroup core
+*/
+class BiotopeGrid {
+public:
+    typedef pair<tuple<int, int>, OrganismHandle> value_type;
+
+    /** @brief Forward iterator over occupied cells
+    */
+    class const_iterator {
+    public:
+        const_iterator(const BiotopeGrid* grid, int index);
+        value_type operator*() const;
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const { return _index == other._index; }
+        bool operator!=(const const_iterator& other) const { return _index != other._index; }
+    private:
+        const BiotopeGrid* _grid;
+        int _index;
+        void _skipFreeCells();
+    };
+
+    BiotopeGrid();
+    void resize(int size_x, int size_y);
+    int index(int x, int y) const { return y * _size_x + x; }
+    int index(const tuple<int, int>& location) const { return index(std::get<0>(location), std::get<1>(location)); }
+    tuple<int, int> location(int index) const { return make_tuple(index % _size_x, index / _size_x); }
+    OrganismHandle get(int index) const { return _cells[index]; }
+    OrganismHandle get(int x, int y) const { return _cells[index(x, y)]; }
+    OrganismHandle get(const tuple<int, int>& location) const { return _cells[index(location)]; }
+    OrganismHandle at(const tuple<int, int>& location) const;
+    size_t count(const tuple<int, int>& location) const { return !get(location).isNull(); }
+    const_iterator find(const tuple<int, int>& location) const;
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, (int)_cells.size()); }
+    size_t size() const { return _num_organisms; }
+    int numCells() const { return (int)_cells.size(); }
+private:
+    friend class Ecosystem;
+    int _size_x;
+    int _size_y;
+    size_t _num_organisms;
+    /** @brief One handle per cell, null handle if the cell is free
+    */
+    vector<OrganismHandle> _cells;
+    void _place(int index, OrganismHandle organism);
+    void _clear(int index);
+};
+
+/** @brief Set of free cells of the biotope allowing O(1) random sampling
+*
+* Free cells are kept in a dense vector, and a per-cell table stores the
+* position (slot) of each cell in that vector (-1 if the cell is occupied).
+* Erasing swaps the last element into the erased slot, so insert, erase,
+* membership test and uniform sampling are all O(1).
+* @ingroup core
+*/
+class FreeLocationList {
+public:
+    FreeLocationList();
+    void resize(int size_x, int size_y);
+    void insert(const tuple<int, int>& location) { this->insert(this->_index(location)); }
+    void insert(int index);
+    void erase(const tuple<int, int>& location) { this->erase(this->_index(location)); }
+    void erase(int index);
+    size_t count(const tuple<int, int>& location) const { return this->_slots[this->_index(location)] >= 0; }
+    size_t size() const { return this->_cells.size(); }
+    tuple<int, int> sample(RandomStream& random) const;
+private:
+    int _size_x;
+    /** @brief Dense vector of free cell indices (y * size_x + x)
+    */
+    vector<int> _cells;
+    /** @brief Position of each cell in _cells, or -1 if it is not free
+    */
+    vector<int> _slots;
+    int _index(const tuple<int, int>& location) const { return get<1>(location) * this->_size_x + get<0>(location); }
+};
+
+/** @brief Bit-packed occupancy layer of the biotope (1 bit per cell)
+*
+* Each row is stored in its own run of 64-bit words, so the 3x3
+* neighborhood of a cell is usually obtained with three word loads
+* (one per row). Neighborhood masks are 9-bit values where bit
+* (dy + 1) * 3 + (dx + 1) tells whether cell (x + dx, y + dy) is occupied,
+* with toroidal wraparound. Bit 4 is the center cell.
+*
+* Words are atomic (with relaxed ordering), so cells sharing a word can be
+* updated from different threads.
+* @ingroup core
+*/
+class OccupancyBitmap {
+public:
+    OccupancyBitmap();
+    void resize(int size_x, int size_y);
+    bool test(int x, int y) const { return (this->_load(this->_word(x, y)) >> (x & 63)) & 1; }
+    void set(int x, int y) { this->_words[this->_word(x, y)].fetch_or(uint64_t(1) << (x & 63), memory_order_relaxed); }
+    void clear(int x, int y) { this->_words[this->_word(x, y)].fetch_and(~(uint64_t(1) << (x & 63)), memory_order_relaxed); }
+    unsigned int neighborhoodMask(int x, int y) const;
+private:
+    int _size_x;
+    int _size_y;
+    int _words_per_row;
+    unique_ptr<atomic<uint64_t>[]> _words;
+    uint64_t _load(int word) const { return this->_words[word].load(memory_order_relaxed); }
+    int _word(int x, int y) const { return y * this->_words_per_row + (x >> 6); }
+    unsigned int _rowBits(int x, int y) const;
+};
+
+/** @brief Bit-packed set of biotope cells changed since it was last drained (1 bit per cell)
+*
+* Fed by addOrganism(), removeOrganism() and updateOrganismLocation(), so
+* that a frame can be drawn by repainting only the cells where organisms
+* were born, died or moved. Words are atomic (with relaxed ordering), so
+* cells can be marked from different threads.
+* @ingroup core
+*/
+class DirtyCellBitmap {
+public:
+    DirtyCellBitmap();
+    void resize(int num_cells);
+    void mark(int index) { this->_words[index >> 6].fetch_or(uint64_t(1) << (index & 63), memory_order_relaxed); }
+    void clear();
+    void drain(vector<int>& cells);
+private:
+    int _num_words;
+    unique_ptr<atomic<uint64_t>[]> _words;
+};
+
+/** @brief State of a (possibly concurrent) sequence of organism actions
+*
+* Organisms act through a context: it provides their random stream and,
+* when several tiles of the biotope evolve in parallel, it collects the
+* changes to shared structures (free locations list, number of organisms,
+* dead organisms) that are applied serially after each parallel phase.
+* @ingroup core
+*/
+struct EvolutionContext {
+    /** @brief Random stream of the organism currently acting in this context
+    */
+    RandomStream* random;
+
+    /** @brief If true, changes to shared structures are logged instead of applied
+    */
+    bool deferred;
+
+    /** @brief Log of free locations changes: cell index if freed, -(index + 1) if occupied
+    */
+    vector<int> free_locs_log;
+
+    /** @brief Change in number of organisms in biotope
+    */
+    int num_organisms_delta;
+
+    /** @brief Organisms died in this context
+    */
+    vector<OrganismHandle> retired;
+
+    EvolutionContext() : random(nullptr), deferred(false), num_organisms_delta(0) {}
+};
+
+/** @brief Attributes of a set of organisms, copied out of an OrganismStore
+* @ingroup core
+*/
+struct CapturedOrganisms {
+    vector<int32_t> location_x;
+    vector<int32_t> location_y;
+    vector<SpeciesId> species;
+    vector<int32_t> age;
+    vector<int32_t> death_age;
+    vector<float> energy_reserve;
+    vector<float> initial_energy_reserve;
+    /** @brief SNAPSHOT_FLAG_* bits
+    */
+    vector<uint8_t> flags;
+    vector<string> cause_of_death;
+
+    void clear();
+    void resize(size_t size);
+    void push_back(const OrganismStore& organisms, uint32_t i, bool with_cause_of_death);
+    void set(size_t k, const OrganismColumns& columns, size_t i);
+    size_t size() const { return location_x.size(); }
+};
+
+/** @brief Read-only pointers to organism attributes stored in columns
+*
+* It lets organisms be built the same way from a mapped snapshot or from a
+* capture.
+* @ingroup core
+*/
+struct OrganismColumns {
+    size_t size;
+    const int32_t* location_x;
+    const int32_t* location_y;
+    const SpeciesId* species;
+    const int32_t* age;
+    const int32_t* death_age;
+    const float* energy_reserve;
+    const float* initial_energy_reserve;
+    const uint8_t* flags;
+
+    OrganismColumns(const SnapshotView& snapshot);
+    OrganismColumns(const DeltaView& delta);
+    OrganismColumns(const CapturedOrganisms& organisms);
+};
+
+/** @brief Copy of the state of an ecosystem, to be saved later (possibly by another thread)
+*
+* Capturing only copies living organisms (in biotope order) and organisms
+* died in last iteration to packed columns. Encoding to .zjson or binary
+* snapshot is done afterwards from the copy. A capture can be reused: its
+* columns keep their memory between captures.
+* @ingroup core
+*/
+struct EcosystemCapture {
+    int time;
+    uint32_t seed;
+    json constants;
+    vector<string> species_names;
+    CapturedOrganisms organisms;
+    CapturedOrganisms dead_organisms;
+
+    void serialize(json& data_json) const;
+    void writeJson(ostream& out) const;
+    void writeSnapshot(ostream& out) const;
+    void readSnapshot(const SnapshotView& snapshot);
+    void writeDelta(ostream& out, const EcosystemCapture& base) const;
+    void applyDelta(const DeltaView& delta);
+};
+
+/** @brief Rectangular region of the biotope evolving as a unit in parallel mode
+*
+* Tiles with the same color are far enough from each other (at least 4 cells)
+* to let their organisms act concurrently without touching the same cells.
+* @ingroup core
+*/
+struct EvolutionTile {
+    int x_begin;
+    int x_end;
+    int y_begin;
+    int y_end;
+    int color;
+
+    /** @brief Organisms in the tile at the beginning of current iteration
+    */
+    vector<OrganismHandle> organisms_to_act;
+
+    EvolutionContext context;
+};
 
 /** @brief Class defining the environment where ecosystem can develop
 *
@@ -69,6 +630,10 @@ public:
     */
     int time;
 
+    /** @brief Seed of all random streams (state "SEED" in settings_json)
+    */
+    uint32_t random_seed;
+
     /** @brief Size of biotope in X axis
     */
     int biotope_size_x;
@@ -77,117 +642,152 @@ public:
     */
     int biotope_size_y;
 
-    /** @brief Main map of organisms in ecosystem
+    /** @brief Attributes of all organisms (alive or dead in current iteration)
+    */
+    OrganismStore organisms;
+
+    /** @brief Main grid of organisms in ecosystem
     *
-    * Keys are (x, y) coordinates (position) and values are pointers
-    * to Organisms living in ecosystem.
+    * It can be read as a map whose keys are (x, y) coordinates (position)
+    * and values are handles to Organisms living in ecosystem.
     */
-    map<tuple<int, int>, Organism*> biotope;
+    BiotopeGrid biotope;
 
     /** @brief Set of free locations in biotope
     *
     * Useful to easily find a new free position
     */
-    set<tuple<int, int>> biotope_free_locs;
+    FreeLocationList biotope_free_locs;
+
+    /** @brief Occupancy bitmap of biotope, kept in sync with biotope
+    *
+    * Used to quickly find free (or occupied) cells around a location
+    */
+    OccupancyBitmap biotope_occupancy;
+
+    /** @brief Cells where organisms were born, died or moved since last drawing
+    *
+    * Drained by captureChangedCells() to redraw only these cells
+    */
+    DirtyCellBitmap biotope_changes;
 
     // Public methods (documentation in ecosystem.cpp)
     Ecosystem();
     Ecosystem(json data_json_);
+    Ecosystem(const SnapshotView& snapshot);
+    Ecosystem(const EcosystemCapture& capture);
     json* getSettings_json_ptr();
-    void addOrganism(Organism* organism);
-    void removeOrganism(Organism* organism);
-    void updateOrganismLocation(Organism* organism);
-    void getSurroundingFreeLocations(tuple<int, int> center, vector<tuple<int, int>> &surrounding_free_locations);
-    void getSurroundingOrganisms(tuple<int, int> center, vector<Organism*> &surrounding_organisms);
+    const CompiledSettings& getCompiledSettings() const { return _compiled_settings; }
+    void compileSettings();
+    OrganismHandle createOrganism(tuple<int, int> location, SpeciesId species, float energy_reserve);
+    OrganismHandle createOrganism(tuple<int, int> location, SpeciesId species, float energy_reserve, EvolutionContext& context);
+    void addOrganism(OrganismHandle organism);
+    void addOrganism(OrganismHandle organism, EvolutionContext& context);
+    void removeOrganism(OrganismHandle organism);
+    void removeOrganism(OrganismHandle organism, EvolutionContext& context);
+    void updateOrganismLocation(OrganismHandle organism);
+    void updateOrganismLocation(OrganismHandle organism, EvolutionContext& context);
+    bool getRandomSurroundingFreeLocation(tuple<int, int> center, tuple<int, int> &free_location, RandomStream& random);
+    int getSurroundingOrganisms(tuple<int, int> center, OrganismHandle surrounding_organisms[8]);
     void evolve();
+    void capture(EcosystemCapture& capture);
     void serialize(json& data_json);
+    void writeSnapshot(ostream& out);
 private:
     // Private attributes
-    /** @brief Vector of dead organisms to be freed
+    /** @brief Constants of settings_json compiled by compileSettings()
+    */
+    CompiledSettings _compiled_settings;
+
+    /** @brief Context of organisms acting serially (changes applied at once)
     */
-    vector<Organism*> _dead_organisms;
+    EvolutionContext _serial_context;
+
+    /** @brief Random stream for draws made outside organisms' actions
+    */
+    RandomStream _random;
+
+    /** @brief Tiles of biotope for parallel evolution (empty if serial)
+    */
+    vector<EvolutionTile> _tiles;
+
+    /** @brief Number of tile colors (phases) for parallel evolution
+    */
+    int _num_tile_phases;
+
+    /** @brief Threads used for parallel evolution
+    */
+    unique_ptr<ThreadPool> _thread_pool;
+
+    /** @brief Mutex protecting organisms store allocation in parallel evolution
+    */
+    mutex _organisms_mtx;
 
     // Private methods (documentation in ecosystem.cpp)
+    void _initializeRandom();
     void _initializeBiotope();
+    void _initializeTiles();
+    void _evolveSerially();
+    void _evolveInParallel();
+    void _applyDeferredChanges(EvolutionContext& context);
     void _initializeOrganisms();
     void _initializeOrganisms(json& data_json);
+    void _initializeFromColumns(const json& constants, int time, uint32_t seed, const OrganismColumns& columns);
+    void _initializeOrganisms(const OrganismColumns& columns);
     tuple<int, int> _getRandomFreeLocation();
+    tuple<int, int> _neighborLocation(int center_x, int center_y, int bit);
     void _deleteDeadOrganisms();
 };
 
 
 
-/** @brief Class defining organism
+/** @brief Class defining organism behaviour
 *
-* A lot of objects of this class are usually used in ecosystem
+* Organism attributes live in Ecosystem::organisms: an Organism object is
+* just a light view over one slot of that store, created on the fly to
+* make the organism act.
 * @ingroup core
 */
 class Organism {
 public:
     // Public attributes
-    /** @brief True if organism is still alive
-    */
-    bool is_alive;
-
-    /** @brief Current location of organism
+    /** @brief Handle of this organism in parent ecosystem's store
     */
-    tuple<int, int> location;
+    OrganismHandle handle;
 
-    /** @brief Old location of organism (before moving)
-    */
-    tuple<int, int> old_location;
-
-    /** @brief Species of this organism: PLANT, HERBIVORE or CARNIVORE
-    */
-    string species;
-
-    /** @brief Energy reserve of the organism.
-    *
-    * If the energy reserve reaches 0, the organism dies because of starvation.
-    */
-    float energy_reserve;
-
-    /** @brief Initial energy reserve of the organism.
-     *
-     */
-    float initial_energy_reserve;
-
-    /** @brief Age of organism
-    */
-    int age;
+    // Public methods (documentation in ecosystem.cpp)
+    Organism(Ecosystem* parent_ecosystem, OrganismHandle handle, EvolutionContext& context);
+    void act();
 
-    /** @brief Death age
+private:
+    // Private attributes
+    /** @brief Pointer to parent ecosystem
     */
-    int death_age;
+    Ecosystem* _parent_ecosystem;
 
-    /** @brief Cause of death (in case it is dead)
+    /** @brief Pointer to the store of parent ecosystem
     */
-    string cause_of_death;
+    OrganismStore* _store;
 
-    /** @brief true if energy matters (typically YES)
+    /** @brief Pointer to the compiled settings of parent ecosystem
     */
-    bool is_energy_dependent;
+    const CompiledSettings* _settings;
 
-    /** @brief Photosynthesis capacity
+    /** @brief Slot of this organism in _store
     */
-    float photosynthesis_capacity;
-
-    // Public methods (documentation in ecosystem.cpp)
-    Organism(tuple<int, int> location, Ecosystem* parent_ecosystem, string& species, float energy_reserve);
-    void act();
+    uint32_t _i;
 
-private:
-    // Private attributes
-    /** @brief Pointer to parent ecosystem
+    /** @brief Context where organism is acting
     */
-    Ecosystem* _parent_ecosystem;
+    EvolutionContext* _context;
 
     // Private methods (documentation in ecosystem.cpp)
+    void _act();
     void _do_photosynthesis();
-    bool _has_enough_energy_to(const string &action);
+    bool _has_enough_energy_to(OrganismAction action);
     void _do_spend_energy(float amount_of_energy);
     void _do_move();
-    bool _is_eatable(Organism* prey);
+    bool _is_eatable(OrganismHandle prey);
     void _do_hunt();
     void _do_procreate();
     void _do_age();
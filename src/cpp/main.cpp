@@ -18,38 +18,75 @@ int main(int argc, char* argv[]) {
     sigemptyset(&sigIntHandler.sa_mask);
     sigIntHandler.sa_flags = 0;
     sigaction(SIGINT, &sigIntHandler, NULL);
+    signal(SIGPIPE, SIG_IGN);  // a video consumer exiting must not kill the simulation
 
-    cout << "Usage: ./ecosystem dst_directory [new]" << endl;
-    cout << " --- " << endl;
     string dst_dir = argv[1];
     bool new_experiment = false;
-    if (argc == 3) {
-        string new_experiment_str = argv[2];
-        new_experiment = (new_experiment_str == "new");
-        if (not new_experiment) {
+    bool export_tga = false;
+    json constants = json::object();
+    if (argc >= 3) {
+        string option_str = argv[2];
+        new_experiment = (option_str == "new");
+        export_tga = (option_str == "export_tga");
+        if ((not new_experiment and not export_tga) or (export_tga and argc > 3) or (argc > 5)) {
             cout << "unknown option!" << endl;
             exit(1);
         }
+        // e.g. "new y4m" streams the new experiment to stdout, "new y4m video.y4m" to a named pipe
+        if (argc >= 4)
+            constants["DRAWING_FORMAT"] = argv[3];
+        if (argc == 5)
+            constants["DRAWING_STREAM"]["path"] = argv[4];
+    }
+    ExperimentInterface* ei = new ExperimentInterface(dst_dir, new_experiment, constants);
+    // video streamed to stdout: messages go to stderr
+    const CompiledSettings& settings = ei->getEcosystemPointer()->getCompiledSettings();
+    bool video_to_stdout = ((settings.drawing_format == DRAWING_Y4M) || (settings.drawing_format == DRAWING_RGB))
+                           && (settings.drawing_stream_path == "-");
+    ostream& info = video_to_stdout ? cerr : cout;
+    info << "Usage: ./ecosystem dst_directory [new [tga|archive|y4m|rgb [stream_path]]|export_tga]" << endl;
+    info << " --- " << endl;
+    if (export_tga) {
+        info << "frames exported: " << ei->exportFramesToTGA() << endl;
+        return 0;
     }
-    ExperimentInterface* ei = new ExperimentInterface(dst_dir, new_experiment);
     while (true) {
         auto start = chrono::steady_clock::now();
         auto num_organisms = ei->getEcosystemPointer()->biotope.size();
         auto num_free_locs = ei->getEcosystemPointer()->biotope_free_locs.size();
-        cout << "Time: " << ei->getRunningTime() << endl;
-        cout << "    num organism: " << num_organisms << endl;
-        cout << "    num free locs: " << num_free_locs << endl;
-        cout << "    sum previous numbers: " << num_organisms + num_free_locs << endl;
+        info << "Time: " << ei->getRunningTime() << endl;
+        info << "    num organism: " << num_organisms << endl;
+        info << "    num free locs: " << num_free_locs << endl;
+        info << "    sum previous numbers: " << num_organisms + num_free_locs << endl;
+        OrganismPoolStats pool_stats = ei->getEcosystemPointer()->organisms.stats();
+        info << "    organism pool: " << pool_stats.live << " live, "
+             << pool_stats.retired << " retired, " << pool_stats.free << " free, "
+             << pool_stats.capacity << " capacity (max live " << pool_stats.max_live << ")" << endl;
+        CheckpointWriterStats backup_stats = ei->getBackupStats();
+        info << "    backups: " << backup_stats.written << " written, "
+             << backup_stats.pending << " pending, " << backup_stats.failed << " failed, "
+             << backup_stats.stalls << " stalls (" << backup_stats.stall_ms << " ms)" << endl;
+        RenderThreadStats render_stats = ei->getRenderStats();
+        info << "    frames: " << render_stats.rendered << " rendered, " << render_stats.failed << " failed, "
+             << render_stats.dropped << " dropped, " << render_stats.pending << " pending (max "
+             << render_stats.max_pending << "), " << render_stats.stalls << " stalls ("
+             << render_stats.stall_ms << " ms)" << endl;
+        FrameStreamStats stream_stats = ei->getFrameStreamStats();
+        if (stream_stats.written + stream_stats.dropped > 0)
+            info << "    video frames: " << stream_stats.written << " written, "
+                 << stream_stats.dropped << " dropped" << endl;
         if (save_and_exit == 1) {
             ei->saveEcosystem();
+            ei->waitForBackups();
+            ei->waitForFrames();
             return 0;
         }
         ei->evolve();
         auto end = chrono::steady_clock::now();
-        cout << "Elapsed time: "
+        info << "Elapsed time: "
 		<< chrono::duration_cast<chrono::milliseconds>(end - start).count()
 		<< " ms" << endl;
-        cout << endl;
+        info << endl;
     }
     return 0;
 }
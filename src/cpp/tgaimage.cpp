@@ -3,7 +3,10 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
+#include <algorithm>
 #include "tgaimage.hpp"
+#include "ThreadPool.h"
 
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {}
 
@@ -141,10 +144,7 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
     return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
-    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+bool TGAImage::write_tga_file(const char *filename, bool rle, ThreadPool *pool) {
     std::ofstream out;
     out.open (filename, std::ios::binary);
     if (!out.is_open()) {
@@ -152,6 +152,16 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         out.close();
         return false;
     }
+    bool ok = write_tga(out, rle, pool);
+    out.close();
+    return ok;
+}
+
+// rows are run-length encoded in parallel if a pool is given
+bool TGAImage::write_tga(std::ostream &out, bool rle, ThreadPool *pool) {
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
     TGA_Header header;
     memset((void *)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp<<3;
@@ -161,7 +171,6 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     header.imagedescriptor = 0x20; // top-left origin
     out.write((char *)&header, sizeof(header));
     if (!out.good()) {
-        out.close();
         std::cerr << "can't dump the tga file\n";
         return false;
     }
@@ -169,12 +178,10 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         out.write((char *)data, width*height*bytespp);
         if (!out.good()) {
             std::cerr << "can't unload raw data\n";
-            out.close();
             return false;
         }
     } else {
-        if (!unload_rle_data(out)) {
-            out.close();
+        if (!unload_rle_data(out, pool)) {
             std::cerr << "can't unload rle data\n";
             return false;
         }
@@ -182,64 +189,125 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     out.write((char *)developer_area_ref, sizeof(developer_area_ref));
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
-        out.close();
         return false;
     }
     out.write((char *)extension_area_ref, sizeof(extension_area_ref));
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
-        out.close();
         return false;
     }
     out.write((char *)footer, sizeof(footer));
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
-        out.close();
         return false;
     }
-    out.close();
     return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width*height;
-    unsigned long curpix = 0;
-    while (curpix<npixels) {
-        unsigned long chunkstart = curpix*bytespp;
-        unsigned long curbyte = curpix*bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bytespp; t++) {
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-            }
-            curbyte += bytespp;
-            if (1==run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
-                break;
-            }
-            run_length++;
+// number of pixels equal to pixel p (itself included) from p on, in a row of n pixels:
+// pixels p..q are equal iff every byte after pixel p equals the byte bytespp before it,
+// so bytes are compared 8 at a time
+static int rle_run_length(const unsigned char *row, int p, int n, int bytespp) {
+    size_t b = (size_t)(p+1)*bytespp;
+    size_t end = (size_t)n*bytespp;
+    while (b+8<=end) {
+        uint64_t cur, prev;
+        memcpy(&cur, row+b, 8);
+        memcpy(&prev, row+b-bytespp, 8);
+        if (cur!=prev) break;
+        b += 8;
+    }
+    while (b<end && row[b]==row[b-bytespp]) b++;
+    return (int)(b/bytespp)-p;
+}
+
+static unsigned char *rle_raw_packets(const unsigned char *row, int from, int to, int bytespp, unsigned char *out) {
+    const int max_chunk_length = 128;
+    while (from<to) {
+        int length = std::min(to-from, max_chunk_length);
+        *out++ = (unsigned char)(length-1);
+        memcpy(out, row+(size_t)from*bytespp, (size_t)length*bytespp);
+        out += (size_t)length*bytespp;
+        from += length;
+    }
+    return out;
+}
+
+// encodes a row of n pixels into out (at most n*(bytespp+1) bytes), returns the end of the encoded data;
+// BPP is the pixel size known at compile time (0 if it is only known at run time)
+template <int BPP>
+static unsigned char *rle_encode_row(const unsigned char *row, int n, int runtime_bytespp, unsigned char *out) {
+    const int max_chunk_length = 128;
+    const int bytespp = BPP ? BPP : runtime_bytespp;
+    // two equal pixels between raw pixels cost 2 * bytespp bytes left in the raw chunk, or
+    // 2 + bytespp bytes as a run-length packet splitting it: only grayscale ones stay raw
+    const bool pairs_stay_raw = (2*bytespp < bytespp+2);
+    int rawstart = 0;
+    int curpix = 0;
+    while (curpix<n) {
+        // pixels different from the next one are raw for sure
+        while (curpix+1<n && memcmp(row+(size_t)curpix*bytespp, row+(size_t)(curpix+1)*bytespp, bytespp)!=0) {
+            curpix++;
         }
-        curpix += run_length;
-        out.put(raw?run_length-1:run_length+127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        int run_length = rle_run_length(row, curpix, n, bytespp);
+        bool stays_raw = (run_length==1) || (run_length==2 && pairs_stay_raw && curpix>rawstart
+                          && curpix+2<n && rle_run_length(row, curpix+2, n, bytespp)==1);
+        if (stays_raw) {
+            curpix += run_length;
+            continue;
         }
-        out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        out = rle_raw_packets(row, rawstart, curpix, bytespp, out);
+        while (run_length>0) {
+            int length = std::min(run_length, max_chunk_length);
+            *out++ = (unsigned char)(length+127);
+            memcpy(out, row+(size_t)curpix*bytespp, bytespp);
+            out += bytespp;
+            curpix += length;
+            run_length -= length;
         }
+        rawstart = curpix;
+    }
+    return rle_raw_packets(row, rawstart, n, bytespp, out);
+}
+
+// packets never span two rows, so bands of rows are encoded independently (in parallel if a pool
+// is given) into rle_buffer, then packed together and written at once
+bool TGAImage::unload_rle_data(std::ostream &out, ThreadPool *pool) {
+    if (width<=0 || height<=0) return true;
+    size_t row_bound = (size_t)width*(bytespp+1);
+    if (rle_buffer.size()<row_bound*height) rle_buffer.resize(row_bound*height);
+    int nbands = pool ? std::min(height, pool->size()*4) : 1;
+    std::vector<size_t> band_size(nbands);
+    unsigned char *buffer = rle_buffer.data();
+    auto band_row = [&](int band) { return (int)((long long)height*band/nbands); };
+    auto encode_band = [&](int band) {
+        unsigned char *start = buffer+row_bound*band_row(band);
+        unsigned char *end = start;
+        for (int y=band_row(band); y<band_row(band+1); y++) {
+            const unsigned char *row = data+(size_t)y*width*bytespp;
+            switch (bytespp) {
+                case GRAYSCALE: end = rle_encode_row<GRAYSCALE>(row, width, bytespp, end); break;
+                case RGB:       end = rle_encode_row<RGB>(row, width, bytespp, end); break;
+                case RGBA:      end = rle_encode_row<RGBA>(row, width, bytespp, end); break;
+                default:        end = rle_encode_row<0>(row, width, bytespp, end);
+            }
+        }
+        band_size[band] = end-start;
+    };
+    if (pool) {
+        pool->parallelFor(nbands, encode_band);
+    } else {
+        encode_band(0);
+    }
+    size_t size = 0;
+    for (int band=0; band<nbands; band++) {
+        memmove(buffer+size, buffer+row_bound*band_row(band), band_size[band]);
+        size += band_size[band];
+    }
+    out.write((char *)buffer, size);
+    if (!out.good()) {
+        std::cerr << "can't dump the tga file\n";
+        return false;
     }
     return true;
 }
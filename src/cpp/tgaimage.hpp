@@ -2,6 +2,10 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <ostream>
+#include <vector>
+
+class ThreadPool;
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -66,9 +70,10 @@ protected:
     int width;
     int height;
     int bytespp;
+    std::vector<unsigned char> rle_buffer; // reused by unload_rle_data
 
     bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out);
+    bool unload_rle_data(std::ostream &out, ThreadPool *pool);
 public:
     enum Format {
         GRAYSCALE=1, RGB=3, RGBA=4
@@ -78,7 +83,8 @@ public:
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage &img);
     bool read_tga_file(const char *filename);
-    bool write_tga_file(const char *filename, bool rle=true);
+    bool write_tga_file(const char *filename, bool rle=true, ThreadPool *pool=NULL);
+    bool write_tga(std::ostream &out, bool rle=true, ThreadPool *pool=NULL);
     bool flip_horizontally();
     bool flip_vertically();
     bool scale(int w, int h);